@@ -0,0 +1,33 @@
+#ifndef ALIGNED_ALLOCATOR
+#define ALIGNED_ALLOCATOR
+
+#include <stdlib.h>
+
+#include <new>
+
+using namespace std;
+
+// Allocates arrays on cache line boundaries, so the distance kernels' loads never straddle two lines needlessly
+template <typename T>
+struct AlignedAllocator {
+    typedef T value_type;
+    static const size_t alignment = 64;
+
+    AlignedAllocator() {}
+    template <typename U> AlignedAllocator(const AlignedAllocator<U> &) {}
+
+    T* allocate(size_t count) {
+        void* p = nullptr;
+        if (posix_memalign(&p, alignment, count * sizeof(T)) != 0) {
+            throw bad_alloc();
+        }
+        return (T*)p;
+    }
+    void deallocate(T* p, size_t) { free(p); }
+
+    template <typename U> struct rebind { typedef AlignedAllocator<U> other; };
+    template <typename U> bool operator==(const AlignedAllocator<U> &) const { return true; }
+    template <typename U> bool operator!=(const AlignedAllocator<U> &) const { return false; }
+};
+
+#endif //ALIGNED_ALLOCATOR
@@ -0,0 +1,293 @@
+#include "benchmark.h"
+
+// Calls f repeatedly for about a tenth of a second, returning the mean nanoseconds per call
+template <typename F>
+static double timeCalls(F f, double & result)
+{
+    unsigned long calls = 0;
+    double sink = 0.0;
+    high_resolution_clock::time_point start = high_resolution_clock::now();
+    double elapsed = 0.0;
+
+    do {
+        for (int i = 0; i < 16; i++) {
+            sink += f();
+        }
+        calls += 16;
+        elapsed = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count();
+    } while (elapsed < 1e8);
+
+    result = f();
+    // stops the calls from being optimised away
+    if (sink == -1.0) {
+        cout << sink;
+    }
+    return elapsed / calls;
+}
+
+static void reportKernel(const string & kernel, unsigned long n, const vector<DistanceKernels> & kernels,
+                         double (*run)(const DistanceKernels & k, unsigned long n))
+{
+    double scalar_ns = 0.0;
+    double scalar_result = 0.0;
+
+    for (auto & k : kernels) {
+        double result;
+        double ns = timeCalls([&] { return run(k, n); }, result);
+        if (k.name == kernels[0].name) {
+            scalar_ns = ns;
+            scalar_result = result;
+        }
+        double difference = fabs(result - scalar_result) / max(fabs(scalar_result), 1e-300);
+        cout << setw(26) << left << kernel << setw(9) << n << setw(8) << k.name << right
+             << setw(12) << fixed << setprecision(1) << ns << " ns"
+             << setw(8) << setprecision(2) << (scalar_ns / ns) << "x"
+             << setw(14) << scientific << setprecision(2) << difference << endl;
+    }
+}
+
+// Reads every document under (or listed in) target_path into memory, so only tokenizing is timed
+static vector<string> readDocuments(const string & target_path)
+{
+    vector<string> paths;
+    if (is_directory(target_path)) {
+        recursive_directory_iterator iter(target_path), end;
+        for (; iter != end; ++iter) {
+            if (is_regular_file(iter->path())) {
+                paths.push_back(iter->path().string());
+            }
+        }
+    } else {
+        std::ifstream fin(target_path);
+        string line;
+        while (getline(fin, line)) {
+            trim_right(line);
+            if (line.length() > 0 && is_regular_file(line)) {
+                paths.push_back(line);
+            }
+        }
+    }
+
+    vector<string> documents;
+    for (auto & filepath : paths) {
+        std::ifstream ifs(filepath, ios::in | ios::binary);
+        documents.push_back(string(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>()));
+    }
+    return documents;
+}
+
+static void runTokenizerBenchmark(const string & target_path)
+{
+    if (!is_directory(target_path) && !is_regular_file(target_path)) {
+        cout << "Need a --path value that is either a file or a directory" << endl;
+        return;
+    }
+    vector<string> documents = readDocuments(target_path);
+    double bytes = 0.0;
+    for (auto & document : documents) {
+        bytes += document.size();
+    }
+
+    RegexTokenizer regex_tokenizer;
+    vector<map<string, int>> expected;
+    expected.reserve(documents.size());
+    high_resolution_clock::time_point start = high_resolution_clock::now();
+    for (auto & document : documents) {
+        expected.push_back(regex_tokenizer.tokenize(document.data(), document.data() + document.size()));
+    }
+    double regex_seconds = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / 1e9;
+
+    // counts the terms the same way DocumentSet does (see processFileGlobally())
+    Tokenizer tokenizer;
+    TermDictionary terms;
+    TermCounter counter;
+    vector<vector<pair<uint32_t, uint32_t>>> found(documents.size());
+    start = high_resolution_clock::now();
+    for (unsigned long i = 0, stop = documents.size(); i < stop; i++) {
+        tokenizer.tokenize(documents[i].data(), documents[i].data() + documents[i].size(), [&] (const string & term) {
+            counter.add(terms.intern(term));
+        });
+        found[i].reserve(counter.terms().size());
+        for (auto term_index : counter.terms()) {
+            found[i].push_back(make_pair(term_index, counter.count(term_index)));
+        }
+        counter.clear();
+    }
+    double seconds = duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / 1e9;
+
+    unsigned long mismatches = 0;
+    for (unsigned long i = 0, stop = documents.size(); i < stop; i++) {
+        map<string, int> counts;
+        for (auto & count : found[i]) {
+            counts[terms.term(count.first)] = count.second;
+        }
+        if (counts != expected[i]) {
+            mismatches++;
+        }
+    }
+
+    double megabytes = bytes / (1024.0 * 1024.0);
+    cout << "Tokenizing " << documents.size() << " documents (" << fixed << setprecision(1) << megabytes << " MB):"
+         << endl;
+    cout << setw(26) << left << "regex" << right << setw(10) << (megabytes / regex_seconds) << " MB/s" << endl;
+    cout << setw(26) << left << "tokenizer" << right << setw(10) << (megabytes / seconds) << " MB/s"
+         << setw(8) << setprecision(2) << (regex_seconds / seconds) << "x" << endl;
+    cout << (mismatches == 0 ? "Identical terms and counts for every document." :
+             to_string(mismatches) + " documents with different terms or counts!") << endl << endl;
+}
+
+// An owned copy of a document, which is what DocumentSet::operator[]() const returned before documents became views
+struct DocumentCopy {
+    string path;
+    vector<unsigned> indices;
+    vector<weight_t> values;
+    vector<int8_t> quantized;
+};
+
+// The documents of a DocumentSet, copied out of it on every access as they used to be, counting the bytes copied
+class CopiedDocuments {
+public:
+    CopiedDocuments(const DocumentSet* docset) : docset(docset) {}
+
+    unsigned int size() const { return docset->size(); }
+
+    // A view of a fresh copy of document i, valid until the calling thread's next access
+    Document operator[](unsigned long i) const {
+        // assigned a new copy every time, so each access allocates (and frees the last copy) as it used to
+        static thread_local DocumentCopy copy;
+        Document doc = (*docset)[i];
+        unsigned long n = doc.nonZeroCount();
+        copy = DocumentCopy { *doc.path, vector<unsigned>(doc.indices, doc.indices + n),
+                              doc.is_quantized ? vector<weight_t>() : vector<weight_t>(doc.values, doc.values + n),
+                              doc.is_quantized ? vector<int8_t>(doc.quantized, doc.quantized + n) : vector<int8_t>() };
+        copied_bytes.fetch_add(copy.path.size() + n * sizeof(unsigned) + copy.values.size() * sizeof(weight_t)
+                               + copy.quantized.size(), memory_order_relaxed);
+        return Document(&copy.path, copy.indices.data(), doc.is_quantized ? nullptr : copy.values.data(), n,
+                        doc.is_quantized, doc.is_quantized ? copy.quantized.data() : nullptr,
+                        doc.quantization_scale, doc.squared_norm);
+    }
+
+    mutable atomic<unsigned long> copied_bytes {0};
+
+private:
+    const DocumentSet* docset;
+};
+
+// Times FitnessEngine::evaluate() on the documents of options.path accessed as views, and copied out of the
+// DocumentSet on every access (see CopiedDocuments)
+static void runDocumentAccessBenchmark(const Options & options)
+{
+    DocumentSet docset(options);
+    if (docset.size() < options.centroid_count) {
+        cout << "Need at least " << options.centroid_count << " documents to time scoring them" << endl;
+        return;
+    }
+    ThreadPool thread_pool(options.thread_count);
+    FitnessEngine fitness_engine(options, &docset, &thread_pool);
+    CopiedDocuments copied_documents(&docset);
+    BasicFitnessEngine<CopiedDocuments> copying_fitness_engine(options, &copied_documents, &thread_pool);
+
+    // centroids started from random documents, as a Star's are
+    std::mt19937_64 generator(options.rand_seed);
+    uniform_int_distribution<unsigned long> document(0, docset.size() - 1);
+    CentroidMatrix centroids(options.centroid_count, Dimension);
+    vector<double> squared_norms(options.centroid_count);
+    for (unsigned j = 0; j < options.centroid_count; j++) {
+        docset[document(generator)].toDense(centroids[j]);
+        squared_norms[j] = Document::squaredNorm(centroids[j]);
+    }
+
+    double view_result, copy_result;
+    double view_ns = timeCalls([&] { return fitness_engine.evaluate(centroids, squared_norms); }, view_result);
+    double copy_ns = timeCalls([&] { return copying_fitness_engine.evaluate(centroids, squared_norms); },
+                               copy_result);
+    copied_documents.copied_bytes = 0;
+    copying_fitness_engine.evaluate(centroids, squared_norms);
+
+    cout << "Scoring " << docset.size() << " documents (" << Dimension << " dimensions) against "
+         << options.centroid_count << " centroids on " << thread_pool.size() << " threads:" << endl;
+    cout << setw(26) << left << "document views" << right << setw(12) << fixed << setprecision(3) << view_ns / 1e6
+         << " ms/evaluation" << endl;
+    cout << setw(26) << left << "document copies" << right << setw(12) << setprecision(3) << copy_ns / 1e6
+         << " ms/evaluation" << setw(8) << setprecision(2) << (copy_ns / view_ns) << "x" << setw(12)
+         << setprecision(1) << copied_documents.copied_bytes / (1024.0 * 1024.0) << " MB copied per evaluation"
+         << endl;
+    cout << (view_result == copy_result ? "Identical fitness." : "Different fitness!") << endl << endl;
+}
+
+static vector<weight_t> a, b, moved;
+static vector<unsigned> sparse_indices;
+static vector<weight_t> sparse_values;
+static vector<int8_t> sparse_quantized;
+
+void runBenchmarks(const Options & options)
+{
+    std::mt19937_64 generator(options.rand_seed);
+    std::uniform_real_distribution<double> weight(0.0, 1.0);
+    std::uniform_int_distribution<int> quantized_weight(-127, 127);
+    vector<DistanceKernels> kernels = supportedKernels();
+
+    cout << "Distance kernels supported by this CPU:";
+    for (auto & k : kernels) {
+        cout << " " << k.name;
+    }
+    cout << endl << endl;
+    cout << setw(26) << left << "kernel" << setw(9) << "n" << setw(8) << "version" << right
+         << setw(15) << "time/call" << setw(9) << "speed-up" << setw(14) << "rel. diff" << endl;
+
+    for (unsigned long n : { 13ul, 1000ul, 16384ul, 262144ul }) {
+        a.resize(n);
+        b.resize(n);
+        for (unsigned long i = 0; i < n; i++) {
+            a[i] = weight(generator);
+            b[i] = weight(generator);
+        }
+        // a typical document only has a few hundred of the terms
+        sparse_indices.clear();
+        sparse_values.clear();
+        sparse_quantized.clear();
+        for (unsigned long i = 0; i < n; i++) {
+            if (n < 400 || weight(generator) < 300.0 / n) {
+                sparse_indices.push_back(i);
+                sparse_values.push_back(weight(generator));
+                sparse_quantized.push_back(quantized_weight(generator));
+            }
+        }
+
+        reportKernel("squared_norm", n, kernels, [] (const DistanceKernels & k, unsigned long n) {
+            return k.squared_norm(a.data(), n);
+        });
+        reportKernel("squared_euclidean", n, kernels, [] (const DistanceKernels & k, unsigned long n) {
+            return k.squared_euclidean(a.data(), b.data(), n);
+        });
+        reportKernel("euclidean", n, kernels, [] (const DistanceKernels & k, unsigned long n) {
+            return sqrt(k.squared_euclidean(a.data(), b.data(), n));
+        });
+        reportKernel("cosine", n, kernels, [] (const DistanceKernels & k, unsigned long n) {
+            return k.cosine(a.data(), b.data(), n);
+        });
+        reportKernel("sparse_dot", n, kernels, [] (const DistanceKernels & k, unsigned long n) {
+            return k.sparse_dot(sparse_indices.data(), sparse_values.data(), sparse_indices.size(), b.data());
+        });
+        reportKernel("sparse_dot_int8", n, kernels, [] (const DistanceKernels & k, unsigned long n) {
+            return k.sparse_dot_int8(sparse_indices.data(), sparse_quantized.data(), sparse_indices.size(), b.data());
+        });
+        reportKernel("sparse_squared_euclidean", n, kernels, [] (const DistanceKernels & k, unsigned long n) {
+            return k.sparse_squared_euclidean(sparse_indices.data(), sparse_values.data(), sparse_indices.size(),
+                                              b.data());
+        });
+        // times copying a too, so every call moves the same centroid
+        reportKernel("move_towards", n, kernels, [] (const DistanceKernels & k, unsigned long n) {
+            moved.assign(a.begin(), a.begin() + n);
+            double squared_norm;
+            double squared_shift = k.move_towards(moved.data(), b.data(), n, 12345, &squared_norm);
+            return squared_shift + squared_norm;
+        });
+        cout << endl;
+    }
+
+    if (!options.path.empty()) {
+        runTokenizerBenchmark(options.path);
+        runDocumentAccessBenchmark(options);
+    }
+}
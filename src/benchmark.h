@@ -0,0 +1,39 @@
+#ifndef BENCHMARK
+#define BENCHMARK
+
+#include "global.h"
+#include "parse_cmd_args.h"
+#include "distance_kernels.h"
+#include "document_set.h"
+#include "fitness_engine.h"
+#include "term_dictionary.h"
+#include "tokenizer.h"
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace std::chrono;
+
+/**
+ * Times every version of the distance kernels this CPU supports against the scalar version (see distance_kernels.h),
+ * printing the time per call, the speed-up, and the relative difference from the scalar result. Vectors are stored as
+ * weight_t, so build with PRECISION=float to time the single precision versions.
+ *
+ * If options.path is set, also times Tokenizer against RegexTokenizer on its documents (see tokenizer.h), printing
+ * the MB/s of each and checking they found exactly the same terms. Then loads them as a DocumentSet, and times
+ * FitnessEngine::evaluate() on them (for options.centroid_count centroids) through the DocumentSet's views against
+ * copying each document out on every access (as accessing a document used to), printing the time per evaluation and
+ * how much copying moves.
+ *
+ * @param   const Options &     options
+ */
+void runBenchmarks(const Options & options);
+
+#endif //BENCHMARK
@@ -3,13 +3,15 @@
 BlackHoleAlgorithm::BlackHoleAlgorithm(const Options & options, const DocumentSet* docset)
     : options(options),
       black_hole_fitness(numeric_limits<double>::max()),
+      mini_batch(options.batch_size > 0 && options.batch_size < docset->size()),
       black_hole_index(-1),
       docset(docset)
 {
+    // the starting stars are scored on every document, so the black hole's fitness is always exact
+    stars.reserve(options.star_count);
     for (unsigned i = 0; i < options.star_count; i++) {
-        Star s(&std_generator64, options, docset, i);
-        stars.push_back(s);
-        double fitness = s.get_current_fitness();
+        stars.emplace_back(&std_generator64, options, docset, i, &thread_pool);
+        double fitness = stars.back().get_current_fitness();
         cout << i << " fitness: " << fitness << endl;
 
         if (fitness < black_hole_fitness) {
@@ -25,23 +27,50 @@ BlackHoleAlgorithm::BlackHoleAlgorithm(const Options & options, const DocumentSe
         cout<< "Failed to set black hole." << endl;
         exit(-1);
     }
+    black_hole_estimate = black_hole_fitness;
     cout<< "Starting fitness: " << black_hole_fitness << " when using "
         << options.centroid_count << " centroids." << endl;
+    if (mini_batch) {
+        cout<< "Scoring the stars on " << options.batch_size << " of the " << docset->size()
+            << " documents each iteration." << endl;
+    }
 }
 
 tuple<Star*, double> BlackHoleAlgorithm::run()
 {
     //update_event_horizon();
-    for (unsigned i = 0; i < options.star_count; i++) {
-        if ((signed)i == black_hole_index) {
-            continue;
+    // In mini-batch mode, every star (including the black hole, so they can be compared) is scored on the same sample
+    // of the documents. Swaps are then confirmed on every document, so black_hole_fitness stays exact.
+    const vector<unsigned>* batch = nullptr;
+    if (mini_batch) {
+        draw_sample();
+        batch = &sample;
+        black_hole->update_fitness(batch);
+        black_hole_estimate = black_hole->get_current_fitness();
+    }
+
+    // Each star only reads the black hole's position and uses its own random number generator, so they can all be
+    // moved at once. Everything below that depends on the order of the stars (swaps, new stars) stays serial.
+    // With fewer stars than threads, the stars are moved one at a time and each of them spreads its fitness
+    // evaluation over the pool instead (see FitnessEngine).
+    const CentroidMatrix & black_hole_position = *black_hole->get_position();
+    auto move_star = [&] (unsigned long i) {
+        if ((signed)i != black_hole_index) {
+            stars[i].move_towards_black_hole(black_hole_position, batch);
+        }
+    };
+    if (options.star_count - 1 >= thread_pool.size()) {
+        thread_pool.parallelFor(options.star_count, move_star);
+    } else {
+        for (unsigned i = 0; i < options.star_count; i++) {
+            move_star(i);
         }
-        stars[i].move_towards_black_hole(*black_hole->get_position());
     }
 
     int swaps = 0;
     int immediate_swaps = 0;
     int new_stars = 0;
+    unsigned long previous_full_evaluations = full_evaluations;
     for (unsigned i = 0; i < options.star_count; i++) {
         if ((signed)i == black_hole_index) {
             continue;
@@ -49,34 +78,47 @@ tuple<Star*, double> BlackHoleAlgorithm::run()
         double fitness = stars[i].get_current_fitness();
 
         // swap star and black hole if star is fitter
-        if (fitness < black_hole_fitness) {
-            //cout<< "Swapping star and black-hole" << endl;
-            swaps++;
-            black_hole->set_not_black_hole();
-            stars[i].set_black_hole();
-            black_hole = &stars[i];
-            black_hole_fitness = fitness;
-            black_hole_index = i;
-            update_event_horizon();
+        if (fitness < black_hole_estimate) {
+            if (confirm_swap(i)) {
+                //cout<< "Swapping star and black-hole" << endl;
+                swaps++;
+                black_hole->set_not_black_hole();
+                stars[i].set_black_hole();
+                black_hole = &stars[i];
+                black_hole_fitness = stars[i].get_current_fitness();
+                black_hole_estimate = fitness;
+                black_hole_index = i;
+                update_event_horizon();
+            } else {
+                // The sample overrated the star, but it's still one of the fittest: a star this close to the black
+                // hole is always inside the event horizon, so it's kept rather than respawned. Its fitness goes back
+                // to the sample estimate the other stars' are, for update_event_horizon() to add them up.
+                stars[i].set_current_fitness(fitness);
+            }
 
         // spawn new star if star is closer than event horizon
-        } else if (fitness - event_horizon < black_hole_fitness) {
+        } else if (fitness - event_horizon < black_hole_estimate) {
             //cout<< "Creating new star" << endl;
             new_stars++;
-            Star s(&std_generator64, options, docset, i);
-            stars[i] = s;
-            double fitness = s.get_current_fitness();
+            stars[i].respawn(&std_generator64, batch);
+            double fitness = stars[i].get_current_fitness();
 
             // swap star and black hole if star is fitter
-            if (fitness < black_hole_fitness) {
-                //cout<< "Swapping star and black-hole immediately" << endl;
-                immediate_swaps++;
-                black_hole->set_not_black_hole();
-                stars[i].set_black_hole();
-                black_hole_fitness = fitness;
-                black_hole = &stars[i];
-                black_hole_index = i;
-                update_event_horizon();
+            if (fitness < black_hole_estimate) {
+                if (confirm_swap(i)) {
+                    //cout<< "Swapping star and black-hole immediately" << endl;
+                    immediate_swaps++;
+                    black_hole->set_not_black_hole();
+                    stars[i].set_black_hole();
+                    black_hole_fitness = stars[i].get_current_fitness();
+                    black_hole_estimate = fitness;
+                    black_hole = &stars[i];
+                    black_hole_index = i;
+                    update_event_horizon();
+                } else {
+                    // as above, the new star keeps its sample estimate
+                    stars[i].set_current_fitness(fitness);
+                }
             }
         }
     }
@@ -92,9 +134,33 @@ tuple<Star*, double> BlackHoleAlgorithm::run()
         }
         cout << endl;
     }
+    if (options.verbose && full_evaluations != previous_full_evaluations) {
+        cout << "Full evaluations: " << (full_evaluations - previous_full_evaluations) << endl;
+    }
     return make_tuple(black_hole, black_hole_fitness);
 }
 
+void BlackHoleAlgorithm::draw_sample()
+{
+    // drawn with replacement, in document order so the documents are read front to back
+    uniform_int_distribution<unsigned> distribution(0, docset->size() - 1);
+    sample.resize(options.batch_size);
+    for (auto & index : sample) {
+        index = distribution(std_generator64);
+    }
+    sort(sample.begin(), sample.end());
+}
+
+bool BlackHoleAlgorithm::confirm_swap(unsigned i)
+{
+    if (!mini_batch) {
+        return true;
+    }
+    stars[i].update_fitness();
+    full_evaluations++;
+    return stars[i].get_current_fitness() < black_hole_fitness;
+}
+
 void BlackHoleAlgorithm::update_event_horizon()
 {
     double total_candidate_fitness = 0;
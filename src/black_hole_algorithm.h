@@ -6,6 +6,7 @@
 #include "document_set.h"
 #include "document.h"
 #include "star.h"
+#include "thread_pool.h"
 
 #include <stdint.h>
 #include <vector>
@@ -23,13 +24,25 @@ public:
 
 private:
     void update_event_horizon();
+    // Draws the documents the stars are scored on this iteration (see Options::batch_size)
+    void draw_sample();
+    // Whether stars[i] is fitter than the black hole over every document, re-scoring it on all of them in mini-batch
+    // mode (where its fitness is only an estimate)
+    bool confirm_swap(unsigned i);
 
     Options options;
+    ThreadPool thread_pool {options.thread_count};
     std::mt19937_64 std_generator64 {options.rand_seed};
     vector<Star> stars;
     Star* black_hole = nullptr;
     double black_hole_fitness;
+    // the black hole's fitness estimated on this iteration's sample, or black_hole_fitness when not in mini-batch mode
+    double black_hole_estimate;
     double event_horizon;
+    // mini-batch mode: the documents the stars are scored on this iteration, and the full evaluations needed so far
+    bool mini_batch = false;
+    vector<unsigned> sample;
+    unsigned long full_evaluations = 0;
     int black_hole_index = -1;
     const DocumentSet* docset;
 };
@@ -0,0 +1,58 @@
+#ifndef BOUNDED_QUEUE
+#define BOUNDED_QUEUE
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+using namespace std;
+
+/**
+ * A first-in first-out queue shared by producer and consumer threads. push() blocks while the queue is full, so a fast
+ * producer can't run arbitrarily far ahead of the consumers, and pop() blocks while it's empty until close() is called.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+    BoundedQueue(unsigned long capacity) : capacity(capacity) {}
+
+    void push(T item) {
+        unique_lock<mutex> guard(lock);
+        not_full.wait(guard, [this] { return items.size() < capacity; });
+        items.push_back(std::move(item));
+        not_empty.notify_one();
+    }
+
+    /**
+     * @param   T &     item    set to the oldest item in the queue
+     * @return  bool            false once the queue is closed and empty
+     */
+    bool pop(T & item) {
+        unique_lock<mutex> guard(lock);
+        not_empty.wait(guard, [this] { return !items.empty() || closed; });
+        if (items.empty()) {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    }
+
+    // No more items will be pushed, consumers can stop once the queue is empty
+    void close() {
+        unique_lock<mutex> guard(lock);
+        closed = true;
+        not_empty.notify_all();
+    }
+
+private:
+    unsigned long capacity;
+    deque<T> items;
+    bool closed = false;
+    mutex lock;
+    condition_variable not_empty;
+    condition_variable not_full;
+};
+
+#endif //BOUNDED_QUEUE
@@ -0,0 +1,43 @@
+#ifndef CENTROID_MATRIX
+#define CENTROID_MATRIX
+
+#include "global.h"
+#include "aligned_allocator.h"
+
+#include <vector>
+
+using namespace std;
+
+/**
+ * A star's centroids, each of them a dense vector of the same dimension, stored one after the other in a single
+ * aligned buffer. Every centroid starts on a cache line (the stride is rounded up to whole lines), so a star's K x D
+ * weights are one allocation that's walked front to back when the star moves.
+ */
+class CentroidMatrix {
+public:
+    CentroidMatrix() {}
+    CentroidMatrix(unsigned long centroid_count, unsigned long dimension) { resize(centroid_count, dimension); }
+
+    // Sets every weight to 0, only allocating if the buffer is too small
+    void resize(unsigned long centroid_count, unsigned long dimension) {
+        static const unsigned long line_weights = AlignedAllocator<weight_t>::alignment / sizeof(weight_t);
+        rows = centroid_count;
+        columns = dimension;
+        stride = (dimension + line_weights - 1) / line_weights * line_weights;
+        weights.assign(rows * stride, 0);
+    }
+
+    // the number of centroids
+    unsigned long size() const { return rows; }
+    unsigned long dimension() const { return columns; }
+    weight_t* operator[](unsigned long j) { return weights.data() + j * stride; }
+    const weight_t* operator[](unsigned long j) const { return weights.data() + j * stride; }
+
+private:
+    unsigned long rows = 0;
+    unsigned long columns = 0;
+    unsigned long stride = 0;
+    vector<weight_t, AlignedAllocator<weight_t>> weights;
+};
+
+#endif //CENTROID_MATRIX
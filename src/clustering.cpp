@@ -18,23 +18,63 @@ string timeElapsed(const high_resolution_clock::time_point & begin, const high_r
     return time.str();
 }
 
+double timeStarMove(const Options & options, const DocumentSet* docset)
+{
+    static const unsigned repeats = 3;
+    ThreadPool thread_pool(options.thread_count);
+    // a generator of its own, so the clustering is the same whether or not it's timed
+    std::mt19937_64 generator(options.rand_seed);
+    Star star(&generator, options, docset, 0, &thread_pool);
+    Star black_hole(&generator, options, docset, 1, &thread_pool);
+
+    high_resolution_clock::time_point start = high_resolution_clock::now();
+    for (unsigned i = 0; i < repeats; i++) {
+        star.move_towards_black_hole(*black_hole.get_position());
+    }
+    return duration_cast<nanoseconds>(high_resolution_clock::now() - start).count() / 1e9 / repeats;
+}
+
 int main(int argc, char **argv)
 {
     Options options(processCmdLineArgs(argc, argv));
     locale::global(locale("en_US.UTF-8"));
 
-    if (options.perform_run) {
+    if (options.perform_run && options.benchmark) {
+        runBenchmarks(options);
+        return EXIT_SUCCESS;
+    } else if (options.perform_run) {
         for (int i = 0; i < argc; i++) {
             cout << argv[i] << " ";
         }
         cout << endl;
         cout << setprecision(32);
         high_resolution_clock::time_point total_start = high_resolution_clock::now();
+        if (options.verbose) {
+            cout << "Using " << Kernels.name << " distance kernels." << endl;
+        }
 
         DocumentSet docset(options);
         if (options.verbose) {
             cout << "Time taken so to process files: " << timeElapsed(total_start, high_resolution_clock::now()) << endl;
         }
+
+        if (options.reduce_dimensions >= (unsigned)Dimension) {
+            cout << "Not reducing the documents, they only have " << Dimension << " dimensions." << endl;
+        } else if (options.reduce_dimensions > 0) {
+            // every iteration moves and scores all the stars but the black hole, which is what reducing speeds up
+            double original_seconds = timeStarMove(options, &docset);
+            high_resolution_clock::time_point reduce_start = high_resolution_clock::now();
+            docset.reduceDimensions(options.reduce_dimensions);
+            if (options.verbose) {
+                cout << "Time to reduce the documents: " << timeElapsed(reduce_start, high_resolution_clock::now()) << endl;
+            }
+            double reduced_seconds = timeStarMove(options, &docset);
+            double saved_seconds = (original_seconds - reduced_seconds) * (options.star_count - 1) * options.num_iterations;
+            cout << "Moving and scoring a star takes " << setprecision(3) << 1000.0 * reduced_seconds << " ms rather than "
+                 << 1000.0 * original_seconds << " ms (" << original_seconds / reduced_seconds << " times faster), "
+                 << "saving about " << saved_seconds << " seconds over " << options.num_iterations << " iterations."
+                 << setprecision(32) << endl;
+        }
         high_resolution_clock::time_point algorithm_start = high_resolution_clock::now();
 
         BlackHoleAlgorithm black_hole_algorithm(options, &docset);
@@ -60,25 +100,14 @@ int main(int argc, char **argv)
             exit(-1);
         }
 
-        vector<pair<int, Document*>> centroid_docs;
-        vector<vector<double>>* centroids = (*best_solution).get_position();
+        CentroidMatrix* centroids = (*best_solution).get_position();
+        // the star already knows each document's cluster and distance from its last evaluation
+        const DistanceBounds & assignment = best_solution->get_assignment();
 
-        for (int i = 0, i_stop = centroids->size(); i < i_stop; i++) {
-            const vector<double> & centroid = (*centroids)[i];
-            int pos = -1;
-            double distance = numeric_limits<double>::max();
-            Document* doc = nullptr;
-
-            for (int j = 0, j_stop = docset.size(); j < j_stop; j++) {
-                double d = docset[j].documentDistance(centroid);
-                if (d <= distance) {
-                    distance = d;
-                    pos = j;
-                    doc = &docset[j];
-                }
-            }
-            if (doc) {
-                centroid_docs.push_back(make_pair(pos, doc));
+        vector<pair<int, Document>> centroid_docs;
+        for (auto pos : best_solution->get_centroid_documents()) {
+            if (pos < docset.size()) {
+                centroid_docs.push_back(make_pair(pos, docset[pos]));
             }
         }
         if (centroid_docs.size() != options.centroid_count) {
@@ -91,26 +120,13 @@ int main(int argc, char **argv)
 
         int i = 1;
         for (auto & d : centroid_docs) {
-            cout<< i++ << " Centroid: " << d.first << " " << (*d.second) << endl;
+            cout<< i++ << " Centroid: " << d.first << " " << d.second << endl;
         }
 
-        vector<tuple<int, Document*, double>> clustered_docs;
+        vector<tuple<int, Document, double>> clustered_docs;
 
         for (int i = 0, i_stop = docset.size(); i < i_stop; i++) {
-            Document* doc = &docset[i];
-            double distance = numeric_limits<double>::max();
-            int centroid_index = -1;
-
-            for (int j = 0, j_stop = centroids->size(); j < j_stop; j++) {
-                double d = doc->documentDistance((*centroids)[j]);
-                if (d <= distance) {
-                    distance = d;
-                    centroid_index = j;
-                }
-            }
-            if (centroid_index != -1) {
-                clustered_docs.push_back(make_tuple(centroid_index, doc, distance));
-            }
+            clustered_docs.push_back(make_tuple(assignment.nearest[i], docset[i], assignment.distance[i]));
         }
         if (clustered_docs.size() != docset.size()) {
             cout<< "Mismatch in clustered_docs (" << clustered_docs.size()
@@ -119,9 +135,9 @@ int main(int argc, char **argv)
         }
         //sort(std::begin(clustered_docs), std::end(clustered_docs));
         sort(std::begin(clustered_docs), std::end(clustered_docs),
-            [] (const tuple<int, Document*, double> & lhs, const tuple<int, Document*, double> & rhs)
+            [] (const tuple<int, Document, double> & lhs, const tuple<int, Document, double> & rhs)
                //{ return get<2>(lhs) < get<2>(rhs); });
-               { return get<1>(lhs)->path < get<1>(rhs)->path; });
+               { return *get<1>(lhs).path < *get<1>(rhs).path; });
 
         int prev = -1;
         for (int i = 0, i_stop = centroids->size(); i < i_stop; i++) {
@@ -131,34 +147,53 @@ int main(int argc, char **argv)
                         cout << endl;
                         prev = i;
                     }
-                    cout<< "Cluster: " << (i + 1) << " " << (*get<1>(clustered_docs[j]))
+                    cout<< "Cluster: " << (i + 1) << " " << get<1>(clustered_docs[j])
                         << " distance: " << get<2>(clustered_docs[j]) << endl;
                 }
             }
         }
 
         vector<int> cluster_counts(centroids->size());
+        // the cluster of each document
+        vector<int> clusters(docset.size(), -1);
 
         for (int i = 0, i_stop = docset.size(); i < i_stop; i++) {
-            double distance = numeric_limits<double>::max();
-            int centroid_index = -1;
-
-            for (int j = 0, j_stop = centroids->size(); j < j_stop; j++) {
-                double d = docset[i].documentDistance((*centroids)[j]);
-                if (d <= distance) {
-                    distance = d;
-                    centroid_index = j;
-                }
-            }
-            if (centroid_index != -1) {
-                cluster_counts[centroid_index] += 1;
-            }
+            cluster_counts[assignment.nearest[i]] += 1;
+            clusters[i] = assignment.nearest[i];
         }
 
         for (int i = 0, i_stop = cluster_counts.size(); i < i_stop; i++) {
             cout<< "Cluster: " << (i + 1) << " contains " << cluster_counts[i] << " documents." << endl;
         }
 
+        // Reduced documents' clusters are measured by the means of their original documents, which (unlike the black
+        // hole's centroids) are in the same space whether or not they were reduced, so the runs can be compared.
+        vector<vector<weight_t>> original_centroids;
+        if (docset.isReduced() || options.verbose) {
+            original_centroids = docset.originalCentroids(clusters, centroids->size());
+            cout<< "Fitness of the cluster means in the original "
+                << (docset.isReduced() ? docset.originalDimension() : Dimension) << " dimensions: "
+                << docset.originalFitness(original_centroids) << endl;
+        }
+
+        // only documents have terms, the iris and wine data sets don't, nor do hashed documents
+        if (options.top_terms > 0 && !options.path.empty() && options.hash_dimensions == 0) {
+            high_resolution_clock::time_point terms_start = high_resolution_clock::now();
+            for (int i = 0, i_stop = centroids->size(); i < i_stop; i++) {
+                const vector<weight_t> centroid = docset.isReduced() ? original_centroids[i]
+                                                  : vector<weight_t>((*centroids)[i], (*centroids)[i] + Dimension);
+                cout<< "Cluster: " << (i + 1) << " top terms:";
+                for (auto & term : docset.topTerms(centroid, options.top_terms)) {
+                    cout<< " " << term.first << " (" << setprecision(3) << term.second << ")";
+                }
+                cout<< endl;
+            }
+            cout << setprecision(32);
+            if (options.verbose) {
+                cout << "Time to find top terms: " << timeElapsed(terms_start, high_resolution_clock::now()) << endl;
+            }
+        }
+
         if (options.verbose) {
             cout << "Time taken in total: " << timeElapsed(total_start, high_resolution_clock::now()) << endl;
         }
@@ -7,6 +7,8 @@
 #include "document_set.h"
 #include "black_hole_algorithm.h"
 #include "star.h"
+#include "distance_kernels.h"
+#include "benchmark.h"
 
 #include <stdint.h>
 
@@ -24,8 +26,11 @@ using namespace std::chrono;
 
 // These are declared in global.h
 int Dimension = 0;
-vector<double> MaxDimensions(0);
+vector<weight_t> MaxDimensions(0);
 
 string timeElapsed(const chrono::high_resolution_clock::time_point & begin, const chrono::high_resolution_clock::time_point & end);
 
+// The mean time, in seconds, it takes a star to move towards another and be scored again (see Star)
+double timeStarMove(const Options & options, const DocumentSet* docset);
+
 #endif //CLUSTERING
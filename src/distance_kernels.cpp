@@ -0,0 +1,721 @@
+#include "distance_kernels.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+static double squaredNormScalar(const weight_t* a, unsigned long n)
+{
+    double sum = 0.0;
+    for (unsigned long i = 0; i < n; i++) {
+        sum += (double)a[i] * a[i];
+    }
+    return sum;
+}
+
+static double squaredEuclideanScalar(const weight_t* a, const weight_t* b, unsigned long n)
+{
+    double sum = 0.0;
+    for (unsigned long i = 0; i < n; i++) {
+        double diff = (double)a[i] - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+static double cosineFromSums(double dot_product, double a_dot_product, double b_dot_product)
+{
+    return dot_product / (sqrt(a_dot_product) * sqrt(b_dot_product));
+}
+
+static double cosineScalar(const weight_t* a, const weight_t* b, unsigned long n)
+{
+    double dot_product = 0.0;
+    double a_dot_product = 0.0;
+    double b_dot_product = 0.0;
+    for (unsigned long i = 0; i < n; i++) {
+        dot_product += (double)a[i] * b[i];
+        a_dot_product += (double)a[i] * a[i];
+        b_dot_product += (double)b[i] * b[i];
+    }
+    return cosineFromSums(dot_product, a_dot_product, b_dot_product);
+}
+
+static double sparseDotScalar(const unsigned* indices, const weight_t* values, unsigned long nnz, const weight_t* v)
+{
+    double sum = 0.0;
+    for (unsigned long i = 0; i < nnz; i++) {
+        sum += (double)values[i] * v[indices[i]];
+    }
+    return sum;
+}
+
+static double sparseDotInt8Scalar(const unsigned* indices, const int8_t* values, unsigned long nnz,
+                                  const weight_t* v)
+{
+    double sum = 0.0;
+    for (unsigned long i = 0; i < nnz; i++) {
+        sum += (double)values[i] * v[indices[i]];
+    }
+    return sum;
+}
+
+static double sparseSquaredEuclideanScalar(const unsigned* indices, const weight_t* values, unsigned long nnz,
+                                           const weight_t* v)
+{
+    // (w - c)^2 - c^2 = w (w - 2c)
+    double sum = 0.0;
+    for (unsigned long i = 0; i < nnz; i++) {
+        sum += (double)values[i] * (values[i] - 2.0 * v[indices[i]]);
+    }
+    return sum;
+}
+
+// moveTowardsScalar() of only a[start, n) (e.g. the few weights left over by a vector kernel)
+static double moveTowardsFrom(weight_t* a, const weight_t* b, unsigned long start, unsigned long n, uint32_t seed,
+                              double* squared_norm)
+{
+    double squared_shift = 0.0;
+    double norm = 0.0;
+    for (unsigned long i = start; i < n; i++) {
+        double previous = a[i];
+        a[i] = previous + randomCoefficient(seed, i) * ((double)b[i] - previous);
+        double change = a[i] - previous;
+        squared_shift += change * change;
+        norm += (double)a[i] * a[i];
+    }
+    *squared_norm = norm;
+    return squared_shift;
+}
+
+static double moveTowardsScalar(weight_t* a, const weight_t* b, unsigned long n, uint32_t seed, double* squared_norm)
+{
+    return moveTowardsFrom(a, b, 0, n, seed, squared_norm);
+}
+
+#ifdef HAVE_X86_KERNELS
+
+// Loading a few weight_t as doubles, so each kernel below works for both precisions
+
+static inline __m128d load2(const double* p)
+{
+    return _mm_loadu_pd(p);
+}
+
+static inline __m128d load2(const float* p)
+{
+    return _mm_cvtps_pd(_mm_castpd_ps(_mm_load_sd((const double*)p)));
+}
+
+// Storing doubles as weight_t, returning the doubles actually stored (i.e. rounded to float in single precision)
+
+static inline __m128d store2(double* p, __m128d v)
+{
+    _mm_storeu_pd(p, v);
+    return v;
+}
+
+static inline __m128d store2(float* p, __m128d v)
+{
+    __m128 rounded = _mm_cvtpd_ps(v);
+    _mm_storel_pi((__m64*)p, rounded);
+    return _mm_cvtps_pd(rounded);
+}
+
+// SSE2 is part of x86-64, so these need no target attribute
+
+static inline double horizontalSum(__m128d sum)
+{
+    return _mm_cvtsd_f64(_mm_add_sd(sum, _mm_unpackhi_pd(sum, sum)));
+}
+
+static double squaredNormSSE2(const weight_t* a, unsigned long n)
+{
+    __m128d sum0 = _mm_setzero_pd(), sum1 = _mm_setzero_pd();
+    unsigned long i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128d a0 = load2(a + i), a1 = load2(a + i + 2);
+        sum0 = _mm_add_pd(sum0, _mm_mul_pd(a0, a0));
+        sum1 = _mm_add_pd(sum1, _mm_mul_pd(a1, a1));
+    }
+    double sum = horizontalSum(_mm_add_pd(sum0, sum1));
+    for (; i < n; i++) {
+        sum += (double)a[i] * a[i];
+    }
+    return sum;
+}
+
+static double squaredEuclideanSSE2(const weight_t* a, const weight_t* b, unsigned long n)
+{
+    __m128d sum0 = _mm_setzero_pd(), sum1 = _mm_setzero_pd();
+    unsigned long i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128d d0 = _mm_sub_pd(load2(a + i), load2(b + i));
+        __m128d d1 = _mm_sub_pd(load2(a + i + 2), load2(b + i + 2));
+        sum0 = _mm_add_pd(sum0, _mm_mul_pd(d0, d0));
+        sum1 = _mm_add_pd(sum1, _mm_mul_pd(d1, d1));
+    }
+    double sum = horizontalSum(_mm_add_pd(sum0, sum1));
+    for (; i < n; i++) {
+        double diff = (double)a[i] - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+static double cosineSSE2(const weight_t* a, const weight_t* b, unsigned long n)
+{
+    __m128d dot = _mm_setzero_pd(), a_dot = _mm_setzero_pd(), b_dot = _mm_setzero_pd();
+    unsigned long i = 0;
+    for (; i + 2 <= n; i += 2) {
+        __m128d a0 = load2(a + i), b0 = load2(b + i);
+        dot = _mm_add_pd(dot, _mm_mul_pd(a0, b0));
+        a_dot = _mm_add_pd(a_dot, _mm_mul_pd(a0, a0));
+        b_dot = _mm_add_pd(b_dot, _mm_mul_pd(b0, b0));
+    }
+    double dot_product = horizontalSum(dot), a_dot_product = horizontalSum(a_dot), b_dot_product = horizontalSum(b_dot);
+    for (; i < n; i++) {
+        dot_product += (double)a[i] * b[i];
+        a_dot_product += (double)a[i] * a[i];
+        b_dot_product += (double)b[i] * b[i];
+    }
+    return cosineFromSums(dot_product, a_dot_product, b_dot_product);
+}
+
+// SSE2 has no gather, so the sparse kernels only pair up the loads
+static double sparseDotSSE2(const unsigned* indices, const weight_t* values, unsigned long nnz, const weight_t* v)
+{
+    __m128d sum = _mm_setzero_pd();
+    unsigned long i = 0;
+    for (; i + 2 <= nnz; i += 2) {
+        __m128d c = _mm_set_pd(v[indices[i + 1]], v[indices[i]]);
+        sum = _mm_add_pd(sum, _mm_mul_pd(load2(values + i), c));
+    }
+    double total = horizontalSum(sum);
+    for (; i < nnz; i++) {
+        total += (double)values[i] * v[indices[i]];
+    }
+    return total;
+}
+
+static double sparseDotInt8SSE2(const unsigned* indices, const int8_t* values, unsigned long nnz, const weight_t* v)
+{
+    __m128d sum = _mm_setzero_pd();
+    unsigned long i = 0;
+    for (; i + 2 <= nnz; i += 2) {
+        __m128d c = _mm_set_pd(v[indices[i + 1]], v[indices[i]]);
+        sum = _mm_add_pd(sum, _mm_mul_pd(_mm_set_pd(values[i + 1], values[i]), c));
+    }
+    double total = horizontalSum(sum);
+    for (; i < nnz; i++) {
+        total += (double)values[i] * v[indices[i]];
+    }
+    return total;
+}
+
+static double sparseSquaredEuclideanSSE2(const unsigned* indices, const weight_t* values, unsigned long nnz,
+                                         const weight_t* v)
+{
+    const __m128d two = _mm_set1_pd(2.0);
+    __m128d sum = _mm_setzero_pd();
+    unsigned long i = 0;
+    for (; i + 2 <= nnz; i += 2) {
+        __m128d w = load2(values + i);
+        __m128d c = _mm_set_pd(v[indices[i + 1]], v[indices[i]]);
+        sum = _mm_add_pd(sum, _mm_mul_pd(w, _mm_sub_pd(w, _mm_mul_pd(two, c))));
+    }
+    double total = horizontalSum(sum);
+    for (; i < nnz; i++) {
+        total += (double)values[i] * (values[i] - 2.0 * v[indices[i]]);
+    }
+    return total;
+}
+
+// SSE2 has no 32-bit multiply keeping the low halves, so it's made of two 32 x 32 -> 64-bit ones
+static inline __m128i multiplyLow32(__m128i a, __m128i b)
+{
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// hashUint32() of 4 counters
+static inline __m128i hash4(__m128i x)
+{
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+    x = multiplyLow32(x, _mm_set1_epi32(0x7feb352d));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 15));
+    x = multiplyLow32(x, _mm_set1_epi32((int)0x846ca68bU));
+    return _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+}
+
+static double moveTowardsSSE2(weight_t* a, const weight_t* b, unsigned long n, uint32_t seed, double* squared_norm)
+{
+    const __m128d scale = _mm_set1_pd(1.0 / 2147483648.0);
+    const __m128i seeds = _mm_set1_epi32((int)seed);
+    __m128d shift_sum = _mm_setzero_pd(), norm_sum = _mm_setzero_pd();
+    unsigned long i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i counters = _mm_add_epi32(_mm_set1_epi32((int)(uint32_t)i), _mm_setr_epi32(0, 1, 2, 3));
+        __m128i random = _mm_srli_epi32(hash4(_mm_xor_si128(seeds, hash4(counters))), 1);
+        __m128d r0 = _mm_mul_pd(_mm_cvtepi32_pd(random), scale);
+        __m128d r1 = _mm_mul_pd(_mm_cvtepi32_pd(_mm_unpackhi_epi64(random, random)), scale);
+
+        __m128d a0 = load2(a + i), a1 = load2(a + i + 2);
+        __m128d moved0 = store2(a + i, _mm_add_pd(a0, _mm_mul_pd(r0, _mm_sub_pd(load2(b + i), a0))));
+        __m128d moved1 = store2(a + i + 2, _mm_add_pd(a1, _mm_mul_pd(r1, _mm_sub_pd(load2(b + i + 2), a1))));
+        __m128d change0 = _mm_sub_pd(moved0, a0), change1 = _mm_sub_pd(moved1, a1);
+        shift_sum = _mm_add_pd(shift_sum, _mm_add_pd(_mm_mul_pd(change0, change0), _mm_mul_pd(change1, change1)));
+        norm_sum = _mm_add_pd(norm_sum, _mm_add_pd(_mm_mul_pd(moved0, moved0), _mm_mul_pd(moved1, moved1)));
+    }
+    double tail_norm;
+    double squared_shift = horizontalSum(shift_sum) + moveTowardsFrom(a, b, i, n, seed, &tail_norm);
+    *squared_norm = horizontalSum(norm_sum) + tail_norm;
+    return squared_shift;
+}
+
+#define AVX2_TARGET __attribute__((target("avx2,fma")))
+
+AVX2_TARGET static inline __m256d load4(const double* p)
+{
+    return _mm256_loadu_pd(p);
+}
+
+AVX2_TARGET static inline __m256d load4(const float* p)
+{
+    return _mm256_cvtps_pd(_mm_loadu_ps(p));
+}
+
+AVX2_TARGET static inline __m256d gather4(const double* base, __m128i index)
+{
+    // _mm256_i32gather_pd() gathers into an _mm256_undefined_pd(), which -Wuninitialized reports
+    const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+    return _mm256_mask_i32gather_pd(_mm256_setzero_pd(), base, index, all, 8);
+}
+
+AVX2_TARGET static inline __m256d gather4(const float* base, __m128i index)
+{
+    return _mm256_cvtps_pd(_mm_i32gather_ps(base, index, 4));
+}
+
+AVX2_TARGET static inline __m256d store4(double* p, __m256d v)
+{
+    _mm256_storeu_pd(p, v);
+    return v;
+}
+
+AVX2_TARGET static inline __m256d store4(float* p, __m256d v)
+{
+    __m128 rounded = _mm256_cvtpd_ps(v);
+    _mm_storeu_ps(p, rounded);
+    return _mm256_cvtps_pd(rounded);
+}
+
+AVX2_TARGET static inline double horizontalSum(__m256d sum)
+{
+    return horizontalSum(_mm_add_pd(_mm256_castpd256_pd128(sum), _mm256_extractf128_pd(sum, 1)));
+}
+
+// hashUint32() of 8 counters
+AVX2_TARGET static inline __m256i hash8(__m256i x)
+{
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+    x = _mm256_mullo_epi32(x, _mm256_set1_epi32(0x7feb352d));
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+    x = _mm256_mullo_epi32(x, _mm256_set1_epi32((int)0x846ca68bU));
+    return _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+}
+
+AVX2_TARGET static double squaredNormAVX2(const weight_t* a, unsigned long n)
+{
+    __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+    unsigned long i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256d a0 = load4(a + i), a1 = load4(a + i + 4);
+        sum0 = _mm256_fmadd_pd(a0, a0, sum0);
+        sum1 = _mm256_fmadd_pd(a1, a1, sum1);
+    }
+    double sum = horizontalSum(_mm256_add_pd(sum0, sum1));
+    for (; i < n; i++) {
+        sum += (double)a[i] * a[i];
+    }
+    return sum;
+}
+
+AVX2_TARGET static double squaredEuclideanAVX2(const weight_t* a, const weight_t* b, unsigned long n)
+{
+    __m256d sum0 = _mm256_setzero_pd(), sum1 = _mm256_setzero_pd();
+    unsigned long i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256d d0 = _mm256_sub_pd(load4(a + i), load4(b + i));
+        __m256d d1 = _mm256_sub_pd(load4(a + i + 4), load4(b + i + 4));
+        sum0 = _mm256_fmadd_pd(d0, d0, sum0);
+        sum1 = _mm256_fmadd_pd(d1, d1, sum1);
+    }
+    double sum = horizontalSum(_mm256_add_pd(sum0, sum1));
+    for (; i < n; i++) {
+        double diff = (double)a[i] - b[i];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+AVX2_TARGET static double cosineAVX2(const weight_t* a, const weight_t* b, unsigned long n)
+{
+    __m256d dot = _mm256_setzero_pd(), a_dot = _mm256_setzero_pd(), b_dot = _mm256_setzero_pd();
+    unsigned long i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d a0 = load4(a + i), b0 = load4(b + i);
+        dot = _mm256_fmadd_pd(a0, b0, dot);
+        a_dot = _mm256_fmadd_pd(a0, a0, a_dot);
+        b_dot = _mm256_fmadd_pd(b0, b0, b_dot);
+    }
+    double dot_product = horizontalSum(dot), a_dot_product = horizontalSum(a_dot), b_dot_product = horizontalSum(b_dot);
+    for (; i < n; i++) {
+        dot_product += (double)a[i] * b[i];
+        a_dot_product += (double)a[i] * a[i];
+        b_dot_product += (double)b[i] * b[i];
+    }
+    return cosineFromSums(dot_product, a_dot_product, b_dot_product);
+}
+
+AVX2_TARGET static double sparseDotAVX2(const unsigned* indices, const weight_t* values, unsigned long nnz,
+                                        const weight_t* v)
+{
+    __m256d sum = _mm256_setzero_pd();
+    unsigned long i = 0;
+    for (; i + 4 <= nnz; i += 4) {
+        __m128i index = _mm_loadu_si128((const __m128i*)(indices + i));
+        sum = _mm256_fmadd_pd(load4(values + i), gather4(v, index), sum);
+    }
+    double total = horizontalSum(sum);
+    for (; i < nnz; i++) {
+        total += (double)values[i] * v[indices[i]];
+    }
+    return total;
+}
+
+AVX2_TARGET static double sparseDotInt8AVX2(const unsigned* indices, const int8_t* values, unsigned long nnz,
+                                            const weight_t* v)
+{
+    __m256d sum = _mm256_setzero_pd();
+    unsigned long i = 0;
+    for (; i + 4 <= nnz; i += 4) {
+        __m128i index = _mm_loadu_si128((const __m128i*)(indices + i));
+        int32_t packed;
+        memcpy(&packed, values + i, sizeof(packed));
+        __m256d w = _mm256_cvtepi32_pd(_mm_cvtepi8_epi32(_mm_cvtsi32_si128(packed)));
+        sum = _mm256_fmadd_pd(w, gather4(v, index), sum);
+    }
+    double total = horizontalSum(sum);
+    for (; i < nnz; i++) {
+        total += (double)values[i] * v[indices[i]];
+    }
+    return total;
+}
+
+AVX2_TARGET static double sparseSquaredEuclideanAVX2(const unsigned* indices, const weight_t* values,
+                                                     unsigned long nnz, const weight_t* v)
+{
+    const __m256d two = _mm256_set1_pd(2.0);
+    __m256d sum = _mm256_setzero_pd();
+    unsigned long i = 0;
+    for (; i + 4 <= nnz; i += 4) {
+        __m128i index = _mm_loadu_si128((const __m128i*)(indices + i));
+        __m256d w = load4(values + i);
+        __m256d c = gather4(v, index);
+        sum = _mm256_fmadd_pd(w, _mm256_fnmadd_pd(two, c, w), sum);
+    }
+    double total = horizontalSum(sum);
+    for (; i < nnz; i++) {
+        total += (double)values[i] * (values[i] - 2.0 * v[indices[i]]);
+    }
+    return total;
+}
+
+AVX2_TARGET static double moveTowardsAVX2(weight_t* a, const weight_t* b, unsigned long n, uint32_t seed,
+                                          double* squared_norm)
+{
+    const __m256d scale = _mm256_set1_pd(1.0 / 2147483648.0);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i seeds = _mm256_set1_epi32((int)seed);
+    __m256d shift_sum = _mm256_setzero_pd(), norm_sum = _mm256_setzero_pd();
+    unsigned long i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i counters = _mm256_add_epi32(_mm256_set1_epi32((int)(uint32_t)i), lanes);
+        __m256i random = _mm256_srli_epi32(hash8(_mm256_xor_si256(seeds, hash8(counters))), 1);
+        __m256d r0 = _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(random)), scale);
+        __m256d r1 = _mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(random, 1)), scale);
+
+        __m256d a0 = load4(a + i), a1 = load4(a + i + 4);
+        __m256d moved0 = store4(a + i, _mm256_fmadd_pd(r0, _mm256_sub_pd(load4(b + i), a0), a0));
+        __m256d moved1 = store4(a + i + 4, _mm256_fmadd_pd(r1, _mm256_sub_pd(load4(b + i + 4), a1), a1));
+        __m256d change0 = _mm256_sub_pd(moved0, a0), change1 = _mm256_sub_pd(moved1, a1);
+        shift_sum = _mm256_fmadd_pd(change1, change1, _mm256_fmadd_pd(change0, change0, shift_sum));
+        norm_sum = _mm256_fmadd_pd(moved1, moved1, _mm256_fmadd_pd(moved0, moved0, norm_sum));
+    }
+    double tail_norm;
+    double squared_shift = horizontalSum(shift_sum) + moveTowardsFrom(a, b, i, n, seed, &tail_norm);
+    *squared_norm = horizontalSum(norm_sum) + tail_norm;
+    return squared_shift;
+}
+
+#define AVX512_TARGET __attribute__((target("avx512f")))
+
+// The AVX-512 versions handle the remainder with masked loads rather than a scalar loop.
+//
+// GCC implements the unmasked forms of some conversions, shifts and extracts (and reduceAdd8(), which uses
+// one) by passing an _mm*_undefined_*() source to the masked builtin, which -Wuninitialized then reports. Their
+// zero-masked forms with every lane enabled give the same results from a zeroed source instead.
+
+// The low half of v, as _mm512_cast*512_*256()
+AVX512_TARGET static inline __m256d lowHalf(__m512d v)
+{
+    return _mm512_maskz_extractf64x4_pd(0xF, v, 0);
+}
+
+AVX512_TARGET static inline __m256 lowHalf(__m512 v)
+{
+    return _mm256_castpd_ps(lowHalf(_mm512_castps_pd(v)));
+}
+
+AVX512_TARGET static inline __m256i lowHalf(__m512i v)
+{
+    return _mm512_maskz_extracti64x4_epi64(0xF, v, 0);
+}
+
+AVX512_TARGET static inline double reduceAdd8(__m512d v)
+{
+    // the same order of additions as _mm512_reduce_add_pd()
+    __m256d sum4 = _mm256_add_pd(lowHalf(v), _mm512_maskz_extractf64x4_pd(0xF, v, 1));
+    __m128d sum2 = _mm_add_pd(_mm256_castpd256_pd128(sum4), _mm256_extractf128_pd(sum4, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(sum2, _mm_unpackhi_pd(sum2, sum2)));
+}
+
+AVX512_TARGET static inline __mmask8 remainderMask(unsigned long remaining)
+{
+    return (remaining >= 8) ? 0xFF : (__mmask8)((1u << remaining) - 1);
+}
+
+AVX512_TARGET static inline __m512d load8(__mmask8 mask, const double* p)
+{
+    return _mm512_maskz_loadu_pd(mask, p);
+}
+
+AVX512_TARGET static inline __m512d load8(__mmask8 mask, const float* p)
+{
+    return _mm512_maskz_cvtps_pd(0xFF, lowHalf(_mm512_maskz_loadu_ps(mask, p)));
+}
+
+AVX512_TARGET static inline __m512d gather8(__mmask8 mask, __m256i index, const double* base)
+{
+    return _mm512_mask_i32gather_pd(_mm512_setzero_pd(), mask, index, base, 8);
+}
+
+AVX512_TARGET static inline __m512d gather8(__mmask8 mask, __m256i index, const float* base)
+{
+    __m512 gathered = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), mask, _mm512_castsi256_si512(index), base, 4);
+    return _mm512_maskz_cvtps_pd(0xFF, lowHalf(gathered));
+}
+
+AVX512_TARGET static inline __m512d store8(__mmask8 mask, double* p, __m512d v)
+{
+    _mm512_mask_storeu_pd(p, mask, v);
+    return v;
+}
+
+AVX512_TARGET static inline __m512d store8(__mmask8 mask, float* p, __m512d v)
+{
+    __m256 rounded = _mm512_maskz_cvtpd_ps(0xFF, v);
+    _mm512_mask_storeu_ps(p, mask, _mm512_castps256_ps512(rounded));
+    return _mm512_maskz_cvtps_pd(0xFF, rounded);
+}
+
+AVX512_TARGET static inline __m256i loadIndices8(__mmask8 mask, const unsigned* indices)
+{
+    return lowHalf(_mm512_maskz_loadu_epi32(mask, indices));
+}
+
+AVX512_TARGET static double squaredNormAVX512(const weight_t* a, unsigned long n)
+{
+    __m512d sum0 = _mm512_setzero_pd(), sum1 = _mm512_setzero_pd();
+    unsigned long i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512d a0 = load8(0xFF, a + i), a1 = load8(0xFF, a + i + 8);
+        sum0 = _mm512_fmadd_pd(a0, a0, sum0);
+        sum1 = _mm512_fmadd_pd(a1, a1, sum1);
+    }
+    for (; i < n; i += 8) {
+        __m512d a0 = load8(remainderMask(n - i), a + i);
+        sum0 = _mm512_fmadd_pd(a0, a0, sum0);
+    }
+    return reduceAdd8(_mm512_add_pd(sum0, sum1));
+}
+
+AVX512_TARGET static double squaredEuclideanAVX512(const weight_t* a, const weight_t* b, unsigned long n)
+{
+    __m512d sum0 = _mm512_setzero_pd(), sum1 = _mm512_setzero_pd();
+    unsigned long i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512d d0 = _mm512_sub_pd(load8(0xFF, a + i), load8(0xFF, b + i));
+        __m512d d1 = _mm512_sub_pd(load8(0xFF, a + i + 8), load8(0xFF, b + i + 8));
+        sum0 = _mm512_fmadd_pd(d0, d0, sum0);
+        sum1 = _mm512_fmadd_pd(d1, d1, sum1);
+    }
+    for (; i < n; i += 8) {
+        __mmask8 mask = remainderMask(n - i);
+        __m512d d0 = _mm512_sub_pd(load8(mask, a + i), load8(mask, b + i));
+        sum0 = _mm512_fmadd_pd(d0, d0, sum0);
+    }
+    return reduceAdd8(_mm512_add_pd(sum0, sum1));
+}
+
+AVX512_TARGET static double cosineAVX512(const weight_t* a, const weight_t* b, unsigned long n)
+{
+    __m512d dot = _mm512_setzero_pd(), a_dot = _mm512_setzero_pd(), b_dot = _mm512_setzero_pd();
+    for (unsigned long i = 0; i < n; i += 8) {
+        __mmask8 mask = remainderMask(n - i);
+        __m512d a0 = load8(mask, a + i), b0 = load8(mask, b + i);
+        dot = _mm512_fmadd_pd(a0, b0, dot);
+        a_dot = _mm512_fmadd_pd(a0, a0, a_dot);
+        b_dot = _mm512_fmadd_pd(b0, b0, b_dot);
+    }
+    return cosineFromSums(reduceAdd8(dot), reduceAdd8(a_dot), reduceAdd8(b_dot));
+}
+
+AVX512_TARGET static double sparseDotAVX512(const unsigned* indices, const weight_t* values, unsigned long nnz,
+                                            const weight_t* v)
+{
+    __m512d sum = _mm512_setzero_pd();
+    for (unsigned long i = 0; i < nnz; i += 8) {
+        __mmask8 mask = remainderMask(nnz - i);
+        __m256i index = loadIndices8(mask, indices + i);
+        sum = _mm512_fmadd_pd(load8(mask, values + i), gather8(mask, index, v), sum);
+    }
+    return reduceAdd8(sum);
+}
+
+AVX512_TARGET static double sparseDotInt8AVX512(const unsigned* indices, const int8_t* values, unsigned long nnz,
+                                                const weight_t* v)
+{
+    __m512d sum = _mm512_setzero_pd();
+    unsigned long i = 0;
+    for (; i + 8 <= nnz; i += 8) {
+        __m256i index = loadIndices8(0xFF, indices + i);
+        __m512d w = _mm512_maskz_cvtepi32_pd(0xFF, _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i*)(values + i))));
+        sum = _mm512_fmadd_pd(w, gather8(0xFF, index, v), sum);
+    }
+    double total = reduceAdd8(sum);
+    for (; i < nnz; i++) {
+        total += (double)values[i] * v[indices[i]];
+    }
+    return total;
+}
+
+AVX512_TARGET static double sparseSquaredEuclideanAVX512(const unsigned* indices, const weight_t* values,
+                                                         unsigned long nnz, const weight_t* v)
+{
+    const __m512d two = _mm512_set1_pd(2.0);
+    __m512d sum = _mm512_setzero_pd();
+    for (unsigned long i = 0; i < nnz; i += 8) {
+        __mmask8 mask = remainderMask(nnz - i);
+        __m256i index = loadIndices8(mask, indices + i);
+        __m512d w = load8(mask, values + i);
+        __m512d c = gather8(mask, index, v);
+        sum = _mm512_fmadd_pd(w, _mm512_fnmadd_pd(two, c, w), sum);
+    }
+    return reduceAdd8(sum);
+}
+
+// hashUint32() of 16 counters
+AVX512_TARGET static inline __m512i hash16(__m512i x)
+{
+    x = _mm512_xor_si512(x, _mm512_maskz_srli_epi32(0xFFFF, x, 16));
+    x = _mm512_mullo_epi32(x, _mm512_set1_epi32(0x7feb352d));
+    x = _mm512_xor_si512(x, _mm512_maskz_srli_epi32(0xFFFF, x, 15));
+    x = _mm512_mullo_epi32(x, _mm512_set1_epi32((int)0x846ca68bU));
+    return _mm512_xor_si512(x, _mm512_maskz_srli_epi32(0xFFFF, x, 16));
+}
+
+AVX512_TARGET static double moveTowardsAVX512(weight_t* a, const weight_t* b, unsigned long n, uint32_t seed,
+                                              double* squared_norm)
+{
+    const __m512d scale = _mm512_set1_pd(1.0 / 2147483648.0);
+    const __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512i seeds = _mm512_set1_epi32((int)seed);
+    __m512d shift_sum = _mm512_setzero_pd(), norm_sum = _mm512_setzero_pd();
+    for (unsigned long i = 0; i < n; i += 16) {
+        // the coefficients of 16 counters, lanes past n are masked off below
+        __m512i counters = _mm512_add_epi32(_mm512_set1_epi32((int)(uint32_t)i), lanes);
+        __m512i x = _mm512_maskz_srli_epi32(0xFFFF, hash16(_mm512_xor_si512(seeds, hash16(counters))), 1);
+
+        for (unsigned half = 0; half < 2 && i + 8 * half < n; half++) {
+            unsigned long start = i + 8 * half;
+            __mmask8 mask = remainderMask(n - start);
+            __m256i random = half ? _mm512_maskz_extracti64x4_epi64(0xF, x, 1) : lowHalf(x);
+            __m512d r = _mm512_mul_pd(_mm512_maskz_cvtepi32_pd(0xFF, random), scale);
+            __m512d previous = load8(mask, a + start);
+            __m512d moved = store8(mask, a + start, _mm512_fmadd_pd(r, _mm512_sub_pd(load8(mask, b + start), previous),
+                                                                     previous));
+            __m512d change = _mm512_sub_pd(moved, previous);
+            shift_sum = _mm512_fmadd_pd(change, change, shift_sum);
+            norm_sum = _mm512_fmadd_pd(moved, moved, norm_sum);
+        }
+    }
+    *squared_norm = reduceAdd8(norm_sum);
+    return reduceAdd8(shift_sum);
+}
+
+#endif //HAVE_X86_KERNELS
+
+static const DistanceKernels scalar_kernels {
+    "scalar", squaredNormScalar, squaredEuclideanScalar, cosineScalar, sparseDotScalar, sparseDotInt8Scalar,
+    sparseSquaredEuclideanScalar, moveTowardsScalar
+};
+
+DistanceKernels Kernels = scalar_kernels;
+
+vector<DistanceKernels> supportedKernels()
+{
+    vector<DistanceKernels> kernels { scalar_kernels };
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    kernels.push_back(DistanceKernels {
+        "sse2", squaredNormSSE2, squaredEuclideanSSE2, cosineSSE2, sparseDotSSE2, sparseDotInt8SSE2,
+        sparseSquaredEuclideanSSE2, moveTowardsSSE2
+    });
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        kernels.push_back(DistanceKernels {
+            "avx2", squaredNormAVX2, squaredEuclideanAVX2, cosineAVX2, sparseDotAVX2, sparseDotInt8AVX2,
+            sparseSquaredEuclideanAVX2, moveTowardsAVX2
+        });
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        kernels.push_back(DistanceKernels {
+            "avx512", squaredNormAVX512, squaredEuclideanAVX512, cosineAVX512, sparseDotAVX512, sparseDotInt8AVX512,
+            sparseSquaredEuclideanAVX512, moveTowardsAVX512
+        });
+    }
+#endif
+    return kernels;
+}
+
+bool selectKernels(const string & name)
+{
+    vector<DistanceKernels> kernels = supportedKernels();
+    if (name.empty()) {
+        Kernels = kernels.back();
+        return true;
+    }
+    for (auto & k : kernels) {
+        if (name == k.name) {
+            Kernels = k;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,87 @@
+#ifndef DISTANCE_KERNELS
+#define DISTANCE_KERNELS
+
+#include "global.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * The inner loops of every distance calculation, in a scalar version and explicitly vectorized SSE2, AVX2 and AVX-512
+ * versions. One binary runs on every machine: the best version the CPU supports is picked at startup (via CPUID), see
+ * selectKernels().
+ *
+ * Vectors are stored as weight_t (see global.h), but always accumulated in double precision.
+ *
+ * Sparse vectors are given as strictly increasing indices into the dense vector they're combined with, plus the
+ * value at each of these indices (see Document).
+ */
+struct DistanceKernels {
+    const char* name;
+
+    // |a|^2
+    double (*squared_norm)(const weight_t* a, unsigned long n);
+    // |a - b|^2
+    double (*squared_euclidean)(const weight_t* a, const weight_t* b, unsigned long n);
+    // a.b / (|a| |b|)
+    double (*cosine)(const weight_t* a, const weight_t* b, unsigned long n);
+    // w.v, for the sparse vector w
+    double (*sparse_dot)(const unsigned* indices, const weight_t* values, unsigned long nnz, const weight_t* v);
+    // w.v for the sparse vector w quantized to 8 bits, i.e. it still needs multiplying by the quantization scale
+    double (*sparse_dot_int8)(const unsigned* indices, const int8_t* values, unsigned long nnz, const weight_t* v);
+    // |w - v|^2 - |v|^2, for the sparse vector w (i.e. the squared euclidean distance, less the part only depending
+    // on v)
+    double (*sparse_squared_euclidean)(const unsigned* indices, const weight_t* values, unsigned long nnz,
+                                       const weight_t* v);
+    // Moves a part of the way towards b, a[i] += r_i (b[i] - a[i]) with r_i = randomCoefficient(seed, i), returning
+    // |a_new - a_old|^2 and setting squared_norm to |a_new|^2 in the same pass
+    double (*move_towards)(weight_t* a, const weight_t* b, unsigned long n, uint32_t seed, double* squared_norm);
+};
+
+// A 32-bit integer hash (Chris Wellons' lowbias32), a bijection with good avalanche that vectorizes as it only needs
+// 32-bit multiplies and shifts
+inline uint32_t hashUint32(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+// The i-th number in [0, 1) of the counter-based random stream of seed, the same whichever kernels compute it. The
+// counter is hashed before it's mixed with the seed, as with seed + i close seeds would give shifted copies of the
+// same stream.
+inline double randomCoefficient(uint32_t seed, unsigned long i)
+{
+    return (hashUint32(seed ^ hashUint32((uint32_t)i)) >> 1) * (1.0 / 2147483648.0);
+}
+
+// The kernels in use, set by selectKernels()
+extern DistanceKernels Kernels;
+
+inline double euclideanDistance(const weight_t* a, const weight_t* b, unsigned long n)
+{
+    return sqrt(Kernels.squared_euclidean(a, b, n));
+}
+
+/**
+ * All versions of the kernels that can run on this CPU, starting with the scalar version and ending with the fastest.
+ */
+vector<DistanceKernels> supportedKernels();
+
+/**
+ * Sets Kernels to the version with the given name ("scalar", "sse2", "avx2" or "avx512"), or to the fastest one the
+ * CPU supports if name is empty.
+ *
+ * @param   const string &  name
+ * @return  bool            false if there is no such version or the CPU doesn't support it
+ */
+bool selectKernels(const string & name);
+
+#endif //DISTANCE_KERNELS
@@ -2,8 +2,10 @@
 #define DOCUMENT
 
 #include "global.h"
+#include "distance_kernels.h"
 
 #include <math.h>
+#include <stdint.h>
 #include <cmath>
 #include <string>
 #include <vector>
@@ -11,61 +13,107 @@
 
 using namespace std;
 
+/**
+ * A read-only view of one document of a DocumentMatrix, which owns the path and weights it points to. Views are cheap
+ * to make and copy, and stay valid until the matrix is changed.
+ */
 struct Document {
 public:
-    string path;
-    vector<double> weights;
+    const string* path;
+    // Sparse layout: strictly increasing dimension indices, and the (non-zero) weight of each of them.
+    // A TF-IDF vector only touches the terms in its own file, so this is a tiny fraction of Dimension.
+    const unsigned* indices;
+    const weight_t* values;
+    unsigned long nonzero_count;
+    // Once quantized (see DocumentMatrix::quantize()), each weight is quantized[i] * quantization_scale instead
+    bool is_quantized;
+    const int8_t* quantized;
+    double quantization_scale;
+    // |w|^2, cached as it never changes once the document is built
+    double squared_norm;
 
-    Document(string path, vector<double> weights) : path(path), weights(weights) {}
+    Document(const string* path, const unsigned* indices, const weight_t* values, unsigned long nonzero_count,
+             bool is_quantized, const int8_t* quantized, double quantization_scale, double squared_norm)
+        : path(path), indices(indices), values(values), nonzero_count(nonzero_count), is_quantized(is_quantized),
+          quantized(quantized), quantization_scale(quantization_scale), squared_norm(squared_norm) {}
 
-    // using this allows easily changing to another distance metric
-    double documentDistance(const vector<double> & v) const {
-        return euclideanDistance(v);
+    unsigned long nonZeroCount() const { return nonzero_count; }
+
+    // the weight of the i-th non-zero term
+    double weight(unsigned long i) const {
+        return is_quantized ? quantized[i] * quantization_scale : values[i];
     }
 
-    double documentDistance(const Document & d) const {
-        return documentDistance(d.weights);
+    // Expands the document to a dense Dimension-sized vector (e.g. to seed a centroid).
+    vector<weight_t> toDense() const {
+        vector<weight_t> weights(Dimension);
+        toDense(weights.data());
+        return weights;
     }
 
-    friend std::ostream & operator<< (std::ostream & os, const Document & d) {
-        os << " [dimensions: " << d.weights.size() << "] " << string("path: ") << d.path;// << endl;
-        /*for (unsigned long i = 0; i < d.weights.size(); i++) {
-            if (d.weights[i]) {
-                os << i << ":" << d.weights[i] <<  " ";
-            }
+    // Writes the document's weights into weights, which must be Dimension zeros
+    void toDense(weight_t* weights) const {
+        for (unsigned long i = 0; i < nonzero_count; i++) {
+            weights[indices[i]] = weight(i);
         }
-        os << endl;*/
-        return os;
     }
 
-private:
-    double euclideanDistance(const vector<double> & v) const {
-        double sum = 0.0;
-        for (int i = 0, stop = weights.size(); i < stop; i++) {
-            sum += pow(weights[i] - v[i], 2.0);
+    static double squaredNorm(const vector<weight_t> & v) {
+        return Kernels.squared_norm(v.data(), v.size());
+    }
+
+    // |v|^2 of a Dimension-sized v (e.g. a row of a CentroidMatrix)
+    static double squaredNorm(const weight_t* v) {
+        return Kernels.squared_norm(v, Dimension);
+    }
+
+    // w.v, visiting only the document's non-zero terms
+    double dotProduct(const weight_t* v) const {
+        if (is_quantized) {
+            return Kernels.sparse_dot_int8(indices, quantized, nonzero_count, v) * quantization_scale;
         }
-        return sqrt(sum / Dimension);
+        return Kernels.sparse_dot(indices, values, nonzero_count, v);
+    }
+
+    double dotProduct(const vector<weight_t> & v) const {
+        return dotProduct(v.data());
+    }
+
+    // using this allows easily changing to another distance metric
+    double documentDistance(const vector<weight_t> & v) const {
+        return euclideanDistance(v.data(), squaredNorm(v));
     }
 
-    double euclideanDistance(const Document & d) const {
-        return euclideanDistance(d.weights);
+    // Prefer this when measuring many documents against the same v, as v_squared_norm (see squaredNorm()) is the
+    // only part of the distance that costs O(Dimension), everything else is O(nonZeroCount()).
+    double documentDistance(const weight_t* v, double v_squared_norm) const {
+        return euclideanDistance(v, v_squared_norm);
     }
 
-    double cosineDistance(const vector<double> & v) const {
-        double dot_product = 0.0;
-        double v_dot_product = 0.0;
-        double w_dot_product = 0.0;
+    double documentDistance(const Document & d) const {
+        return documentDistance(d.toDense());
+    }
 
-        for (int i = 0, stop = weights.size(); i < stop; i++) {
-            dot_product += weights[i] * v[i];
-            v_dot_product += v[i] * v[i];
-            w_dot_product += weights[i] * weights[i];
+    friend std::ostream & operator<< (std::ostream & os, const Document & d) {
+        os << " [dimensions: " << Dimension << ", non-zero: " << d.nonzero_count << "] " << string("path: ") << *d.path;
+        return os;
+    }
+
+private:
+    // sum((w - v)^2) over all dimensions equals |v|^2 plus, for each non-zero w, (w - v)^2 - v^2. So only the
+    // document's own terms need visiting.
+    double euclideanDistance(const weight_t* v, double v_squared_norm) const {
+        double sum = v_squared_norm;
+        if (is_quantized) {
+            sum += squared_norm - 2.0 * dotProduct(v);
+        } else {
+            sum += Kernels.sparse_squared_euclidean(indices, values, nonzero_count, v);
         }
-        return dot_product / (sqrt(v_dot_product) * sqrt(w_dot_product));
+        return sqrt(max(sum, 0.0) / Dimension);
     }
 
-    double cosineDistance(const Document & d) const {
-        return cosineDistance(d.weights);
+    double cosineDistance(const weight_t* v, double v_squared_norm) const {
+        return dotProduct(v) / (sqrt(v_squared_norm) * sqrt(squared_norm));
     }
 };
 
@@ -0,0 +1,78 @@
+#include "document_matrix.h"
+
+void DocumentMatrix::reserve(unsigned long document_count, unsigned long nonzero_count)
+{
+    paths.reserve(document_count);
+    offsets.reserve(document_count + 1);
+    squared_norms.reserve(document_count);
+    indices.reserve(nonzero_count);
+    values.reserve(nonzero_count);
+}
+
+void DocumentMatrix::clear()
+{
+    DocumentMatrix().swap(*this);
+}
+
+void DocumentMatrix::swap(DocumentMatrix & other)
+{
+    paths.swap(other.paths);
+    offsets.swap(other.offsets);
+    indices.swap(other.indices);
+    values.swap(other.values);
+    std::swap(is_quantized, other.is_quantized);
+    quantized.swap(other.quantized);
+    quantization_scales.swap(other.quantization_scales);
+    squared_norms.swap(other.squared_norms);
+}
+
+void DocumentMatrix::add(const string & path, const unsigned* document_indices, const weight_t* document_values,
+                         unsigned long nonzero_count)
+{
+    paths.push_back(path);
+    indices.insert(indices.end(), document_indices, document_indices + nonzero_count);
+    values.insert(values.end(), document_values, document_values + nonzero_count);
+    offsets.push_back(indices.size());
+    squared_norms.push_back(Kernels.squared_norm(document_values, nonzero_count));
+}
+
+void DocumentMatrix::add(const string & path, const vector<weight_t> & weights)
+{
+    unsigned long start = indices.size();
+    for (unsigned i = 0, stop = weights.size(); i < stop; i++) {
+        if (weights[i] != 0.0) {
+            indices.push_back(i);
+            values.push_back(weights[i]);
+        }
+    }
+    paths.push_back(path);
+    offsets.push_back(indices.size());
+    squared_norms.push_back(Kernels.squared_norm(values.data() + start, values.size() - start));
+}
+
+double DocumentMatrix::quantize()
+{
+    double max_error = 0.0;
+    quantized.resize(values.size());
+    quantization_scales.resize(size());
+
+    for (unsigned long d = 0, d_stop = size(); d < d_stop; d++) {
+        double max_weight = 0.0;
+        for (unsigned long i = offsets[d]; i < offsets[d + 1]; i++) {
+            max_weight = max(max_weight, fabs((double)values[i]));
+        }
+        double scale = max_weight > 0.0 ? max_weight / 127.0 : 1.0;
+        quantization_scales[d] = scale;
+
+        double squared_norm = 0.0;
+        for (unsigned long i = offsets[d]; i < offsets[d + 1]; i++) {
+            quantized[i] = (int8_t)lround(values[i] / scale);
+            max_error = max(max_error, fabs(values[i] - quantized[i] * scale));
+            squared_norm += (quantized[i] * scale) * (quantized[i] * scale);
+        }
+        squared_norms[d] = squared_norm;
+    }
+    is_quantized = true;
+    vector<weight_t, AlignedAllocator<weight_t>>().swap(values);
+    return max_error;
+}
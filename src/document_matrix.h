@@ -0,0 +1,91 @@
+#ifndef DOCUMENT_MATRIX
+#define DOCUMENT_MATRIX
+
+#include "global.h"
+#include "document.h"
+#include "aligned_allocator.h"
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Every document of a DocumentSet in compressed sparse row (CSR) form: the dimension indices and weights of all the
+ * documents one after the other in two contiguous arrays, with offsets[d] the first non-zero term of document d. The
+ * paths are kept in a table of their own, so scoring the documents in order streams through the arrays front to back
+ * instead of visiting a separate heap block (or two) per document.
+ */
+class DocumentMatrix {
+public:
+    // Visits the documents in order, as views (see operator[]())
+    class const_iterator {
+    public:
+        const_iterator(const DocumentMatrix* matrix, unsigned long d) : matrix(matrix), d(d) {}
+        Document operator*() const { return (*matrix)[d]; }
+        const_iterator & operator++() { d++; return *this; }
+        bool operator==(const const_iterator & other) const { return d == other.d; }
+        bool operator!=(const const_iterator & other) const { return d != other.d; }
+
+    private:
+        const DocumentMatrix* matrix;
+        unsigned long d;
+    };
+
+    unsigned long size() const { return paths.size(); }
+    bool empty() const { return paths.empty(); }
+    // The total number of non-zero terms of the documents
+    unsigned long nonZeroCount() const { return offsets.back(); }
+
+    // A view of document d, valid until the matrix is changed. Only one of values and quantized is in use, the other
+    // may be empty (with a null data()), so it's passed as nullptr rather than offset.
+    Document operator[](unsigned long d) const {
+        return Document(&paths[d], indices.data() + offsets[d],
+                        is_quantized ? nullptr : values.data() + offsets[d], offsets[d + 1] - offsets[d], is_quantized,
+                        is_quantized ? quantized.data() + offsets[d] : nullptr,
+                        is_quantized ? quantization_scales[d] : 0.0, squared_norms[d]);
+    }
+    const string & path(unsigned long d) const { return paths[d]; }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, size()); }
+    // The whole arrays, document d's terms being [documentOffsets()[d], documentOffsets()[d + 1]) of them (values
+    // are empty once quantized)
+    const vector<uint64_t> & documentOffsets() const { return offsets; }
+    const unsigned* indexData() const { return indices.data(); }
+    const weight_t* valueData() const { return values.data(); }
+
+    void reserve(unsigned long document_count, unsigned long nonzero_count);
+    void clear();
+    void swap(DocumentMatrix & other);
+
+    // Appends a document in the sparse layout (strictly increasing dimension indices, and the weight of each of them)
+    void add(const string & path, const unsigned* document_indices, const weight_t* document_values,
+             unsigned long nonzero_count);
+    // Appends a dense weight vector, dropping all zero weights
+    void add(const string & path, const vector<weight_t> & weights);
+
+    /**
+     * Replaces the weights with 8-bit integers (plus a scale for each document), for an eighth of the memory traffic
+     * of doubles when measuring distances. No documents can be added afterwards.
+     *
+     * @return  double  the largest difference between a weight and its quantized value
+     */
+    double quantize();
+    bool isQuantized() const { return is_quantized; }
+
+private:
+    vector<string> paths;
+    vector<uint64_t> offsets {0};
+    vector<unsigned, AlignedAllocator<unsigned>> indices;
+    vector<weight_t, AlignedAllocator<weight_t>> values;
+    // once quantized, values is emptied and each document's weights are quantized[i] * quantization_scales[d] instead
+    bool is_quantized = false;
+    vector<int8_t, AlignedAllocator<int8_t>> quantized;
+    vector<double> quantization_scales;
+    // |w|^2 of each document
+    vector<double> squared_norms;
+};
+
+#endif //DOCUMENT_MATRIX
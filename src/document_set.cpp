@@ -13,43 +13,134 @@ DocumentSet::DocumentSet(const Options & options)
         cout<< "No documents available." << endl;
         exit(-1);
     }
+
+    if (options.quantize) {
+        quantizeDocuments();
+    }
+}
+
+void DocumentSet::quantizeDocuments()
+{
+    double max_error = 0.0;
+    double max_weight = 0.0;
+    for (Document doc : documents) {
+        for (unsigned long i = 0, stop = doc.nonZeroCount(); i < stop; i++) {
+            max_weight = max(max_weight, fabs(doc.weight(i)));
+        }
+    }
+    max_error = documents.quantize();
+    cout << "Quantized document weights to 8 bits, largest error: " << max_error << " ("
+         << (max_weight > 0.0 ? 100.0 * max_error / max_weight : 0.0) << "% of the largest weight)." << endl;
 }
 
 void DocumentSet::initFiles()
 {
-    total_count = processPaths(options.path, &DocumentSet::processFileGlobally);
+    vector<string> paths = listPaths(options.path);
+    vector<FileStamp> stamps;
+    uint64_t cache_key = 0;
+    vector<bool> cached;
+    bool incremental = false;
+    if (!options.cache_path.empty()) {
+        stamps = stampFiles(paths);
+        cache_key = corpusKey(paths, stamps);
+        if (readCache(options.cache_path, cache_key)) {
+            if (options.verbose) {
+                cout << "Read the document vectors from " << options.cache_path << endl;
+            }
+            checkDocumentCount();
+            return;
+        }
+        // the corpus changed since it was cached, so only the new and changed files need processing
+        incremental = readCachedTermCounts(options.cache_path, paths, stamps, cached);
+    }
+
+    if (incremental) {
+        processChangedPaths(paths, cached);
+        compactVocabulary();
+    } else {
+        processPaths(paths);
+    }
+    total_count = file_term_counts.size();
 
-    //rewrite file_statistics to remove all rare terms (ones that aren't meaningful for clustering).
-    map<string, Stats> min_stats;
-    unsigned counter = 0;
+    vector<int> pruned_index = pruneVocabulary();
 
-    multiset<unsigned> sorted_set;
+    Dimension = dimension_freqs.size(); //global variables from global.h
+    MaxDimensions.resize(Dimension);
+    // the files' term counts were kept by processFileGlobally, so there's no need to read them again
+    for (auto & file : file_term_counts) {
+        processFileLocally(file, pruned_index);
+    }
+    cout<< endl;
 
-    unsigned stop = (unsigned)((double)file_statistics.size() / 100.0 * 0.1);
-    for (auto & stat : file_statistics) {
-        if (sorted_set.size() < stop) {
-            sorted_set.insert(stat.second.global_word_freq);
-        } else if (stat.second.global_word_freq > *sorted_set.begin()) {
-            sorted_set.erase(sorted_set.begin());
-            sorted_set.insert(stat.second.global_word_freq);
+    checkDocumentCount();
+    if (!options.cache_path.empty()) {
+        if (!writeCache(options.cache_path, cache_key, paths, stamps)) {
+            cout << "Unable to write the cache " << options.cache_path << endl;
+        } else if (options.verbose) {
+            cout << "Wrote the document vectors to " << options.cache_path << endl;
         }
-        /*if (stat.second.global_word_freq > 3000) {
-            cout << stat.first << " " << stat.second.global_word_freq << endl;
-        }*/
     }
+    vector<TermCounts>().swap(file_term_counts);
+}
+
+vector<int> DocumentSet::pruneVocabulary()
+{
+    if (options.hash_dimensions > 0) {
+        // every bucket is a dimension, there are no terms to choose from
+        dimension_terms.clear();
+        dimension_freqs = vocabulary_freqs;
+        vector<int> pruned_index(options.hash_dimensions);
+        iota(pruned_index.begin(), pruned_index.end(), 0);
+        return pruned_index;
+    }
+
+    auto alphabetical = [this] (unsigned a, unsigned b) {
+        int order = memcmp(vocabulary.data(a), vocabulary.data(b), min(vocabulary.length(a), vocabulary.length(b)));
+        return order < 0 || (order == 0 && vocabulary.length(a) < vocabulary.length(b));
+    };
+
+    // The most frequent 0.1% of the terms are too common to tell documents apart. They're dropped along with every
+    // other term as frequent as the least frequent of them, so the cut-off is the frequency of the drop_count-th most
+    // frequent term.
+    unsigned long drop_count = (unsigned long)((double)vocabulary_freqs.size() / 100.0 * 0.1);
+    unsigned long too_frequent = numeric_limits<unsigned long>::max();
+    if (drop_count > 0) {
+        vector<unsigned> freqs(vocabulary_freqs);
+        nth_element(freqs.begin(), freqs.begin() + (drop_count - 1), freqs.end(), greater<unsigned>());
+        too_frequent = freqs[drop_count - 1];
+    }
+    double max_freq = options.max_df * total_count;
 
-    for (auto & stat : file_statistics) {
-    	if (stat.second.global_word_freq > 1 && stat.second.global_word_freq < *sorted_set.begin()) {
-            min_stats[stat.first] = Stats {stat.second.global_word_freq, counter++};
+    dimension_terms.clear();
+    for (unsigned i = 0, i_stop = vocabulary_freqs.size(); i < i_stop; i++) {
+        unsigned freq = vocabulary_freqs[i];
+        if (freq >= options.min_df && freq < too_frequent && freq <= max_freq) {
+            dimension_terms.push_back(i);
         }
     }
-    file_statistics = min_stats;
+    // keeping the most frequent terms (ties go to the alphabetically first, so cached runs give the same result)
+    if (options.max_vocabulary > 0 && dimension_terms.size() > options.max_vocabulary) {
+        nth_element(dimension_terms.begin(), dimension_terms.begin() + (options.max_vocabulary - 1),
+                    dimension_terms.end(), [&] (unsigned a, unsigned b) {
+            return vocabulary_freqs[a] > vocabulary_freqs[b]
+                   || (vocabulary_freqs[a] == vocabulary_freqs[b] && alphabetical(a, b));
+        });
+        dimension_terms.resize(options.max_vocabulary);
+    }
+    // the dimensions are numbered in the alphabetical order of their terms
+    sort(dimension_terms.begin(), dimension_terms.end(), alphabetical);
 
-    Dimension = file_statistics.size(); //global variables from global.h
-    MaxDimensions.resize(Dimension);
-    total_count = processPaths(options.path, &DocumentSet::processFileLocally);
-    cout<< endl;
+    vector<int> pruned_index(vocabulary.size(), -1);
+    dimension_freqs.clear();
+    for (unsigned i = 0, i_stop = dimension_terms.size(); i < i_stop; i++) {
+        pruned_index[dimension_terms[i]] = i;
+        dimension_freqs.push_back(vocabulary_freqs[dimension_terms[i]]);
+    }
+    return pruned_index;
+}
 
+void DocumentSet::checkDocumentCount() const
+{
     if (total_count == 0) {
         cout << "No valid documents exist. Exiting." << endl;
         exit(-1);
@@ -65,150 +156,299 @@ void DocumentSet::initFiles()
     }
 }
 
-uint64_t DocumentSet::processPaths(string target_path, bool (DocumentSet::*f) (const string & filepath))
+vector<string> DocumentSet::listPaths(const string & target_path) const
 {
-    uint64_t success_count = 0;
-    uint64_t total_count = 0;
+    if (!is_directory(target_path) && !is_regular_file(target_path)) {
+        throw string("Invalid file type");
+    }
+
+    vector<string> paths;
     if (is_directory(target_path)) {
         path targetDir(target_path);
         recursive_directory_iterator iter(targetDir), end;
         while (iter != end) {
             if (is_regular_file(iter->path())) {
-                if ((this->*f)(iter->path().string())) {
-                    success_count++;
-                }
-                total_count++;
+                paths.push_back(iter->path().string());
             }
             ++iter;
         }
-    } else if (is_regular_file(target_path)) {
+    } else {
         std::ifstream fin(target_path);
         string line;
 
         while(getline(fin, line)) {
             trim_right(line);
             if (line.length() > 0) {
-                if ((this->*f)(line)) {
-                    success_count++;
-                }
-                total_count++;
+                paths.push_back(line);
             }
         }
-    } else {
-        throw string("Invalid file type");
     }
+    return paths;
+}
+
+uint64_t DocumentSet::processPaths(const vector<string> & paths)
+{
+    // The calling thread hands the paths over to the ingestion threads (each with its own table of terms) to be read,
+    // tokenized and stemmed. The tables are merged once all the files have been processed.
+    unsigned thread_count = options.thread_count;
+    BoundedQueue<pair<uint64_t, string>> queue(16 * thread_count);
+    vector<IngestionTable> tables(thread_count);
+    vector<thread> workers;
+    mutex output_lock;
+    uint64_t processed_count = 0;
+
+    for (unsigned t = 0; t < thread_count; t++) {
+        workers.push_back(thread([&, t] {
+            pair<uint64_t, string> item;
+            FileReader reader;
+            Tokenizer tokenizer;
+            while (queue.pop(item)) {
+                if (options.verbose && options.have_stdout) {
+                    lock_guard<mutex> guard(output_lock);
+                    cout << "\r" << "Processing file #" << (++processed_count) << " " << item.second;
+                }
+                // files that can't be processed are simply left out of the table
+                processFileGlobally(item.first, item.second, tables[t], reader, tokenizer);
+            }
+        }));
+    }
+
+    uint64_t previous_count = file_term_counts.size();
+    uint64_t total_count = paths.size();
+    for (uint64_t position = 0; position < total_count; position++) {
+        queue.push(make_pair(position, paths[position]));
+    }
+    queue.close();
+    for (auto & worker : workers) {
+        worker.join();
+    }
+
+    mergeIngestionTables(tables);
+
+    uint64_t success_count = file_term_counts.size() - previous_count;
     if (total_count > success_count) {
         cout << "Unable to process " << (total_count - success_count) << " files." << endl;
     }
     return success_count;
 }
 
-bool DocumentSet::processFileGlobally(const string & filepath)
+void DocumentSet::processChangedPaths(const vector<string> & paths, const vector<bool> & cached)
+{
+    vector<string> changed_paths;
+    for (unsigned long p = 0, stop = paths.size(); p < stop; p++) {
+        if (!cached[p]) {
+            changed_paths.push_back(paths[p]);
+        }
+    }
+    uint64_t cached_count = file_term_counts.size();
+    processPaths(changed_paths);
+    if (options.verbose) {
+        cout << "Reused " << cached_count << " cached files, processed " << changed_paths.size()
+             << " new or changed files" << endl;
+    }
+
+    // The cached files, followed by the processed ones, are each in the order of paths. Files that couldn't be
+    // processed are missing, so the processed ones are matched up by path.
+    vector<TermCounts> ordered;
+    ordered.reserve(file_term_counts.size());
+    auto cached_file = file_term_counts.begin();
+    auto changed_file = file_term_counts.begin() + cached_count;
+    for (unsigned long p = 0, stop = paths.size(); p < stop; p++) {
+        if (cached[p]) {
+            ordered.push_back(std::move(*cached_file++));
+        } else if (changed_file != file_term_counts.end() && changed_file->path == paths[p]) {
+            ordered.push_back(std::move(*changed_file++));
+        }
+    }
+    file_term_counts.swap(ordered);
+}
+
+void DocumentSet::compactVocabulary()
 {
-    static int file_count = 0;
-    if (options.verbose && options.have_stdout) {
-        cout << "\r" << "Processing file globally #" << (file_count + 1) << " " << filepath;
-    }
-	file_count++;
-	map<string, int> result = getUpdated(filepath);
-	static unsigned term_counter = 0;
-	for (auto & stats : result) {
-		if (file_statistics.find(stats.first) == file_statistics.end()) {
-			file_statistics[stats.first] = Stats {1, term_counter++};
-		} else {
-			file_statistics[stats.first].global_word_freq += 1;//stats.second if not doing per file level...
+    if (options.hash_dimensions > 0) {
+        // the buckets are the dimensions, whether or not any file still has terms in them
+        return;
+    }
+    TermDictionary compacted;
+    vector<unsigned> compacted_freqs;
+    vector<uint32_t> new_index(vocabulary.size(), TermDictionary::npos);
+    for (uint32_t i = 0, stop = vocabulary.size(); i < stop; i++) {
+        if (vocabulary_freqs[i] > 0) {
+            new_index[i] = compacted.intern(vocabulary.data(i), vocabulary.length(i));
+            compacted_freqs.push_back(vocabulary_freqs[i]);
+        }
+    }
+    swap(vocabulary, compacted);
+    vocabulary_freqs.swap(compacted_freqs);
+    for (auto & file : file_term_counts) {
+        for (auto & stats : file.counts) {
+            stats.first = new_index[stats.first];
+        }
+    }
+}
+
+bool DocumentSet::processFileGlobally(uint64_t position, const string & filepath, IngestionTable & table,
+                                      FileReader & reader, Tokenizer & tokenizer) const
+{
+	if (!reader.open(filepath)) {
+		return false;
+	}
+	// the tokenizer works directly on the mapped (or read) bytes
+	TermCounter & counter = table.counter;
+	unsigned long buckets = options.hash_dimensions;
+	if (buckets > 0) {
+		// Signed feature hashing: a term adds to its bucket, or takes away from it, depending on the top bit of a
+		// second hash (so the sign doesn't depend on the bucket), and collisions tend to cancel out rather than add
+		// up. Counted as 2 * bucket, plus 1 when negative.
+		tokenizer.tokenize(reader.begin(), reader.end(), [&] (const string & term) {
+			uint64_t h = TermDictionary::hash(term.data(), term.size());
+			uint64_t sign = TermDictionary::hash(term.data(), term.size(), 0x9e3779b97f4a7c15ull) >> 63;
+			counter.add(2 * (h % buckets) + sign);
+		});
+	} else {
+		tokenizer.tokenize(reader.begin(), reader.end(), [&] (const string & term) {
+			counter.add(table.terms.intern(term));
+		});
+	}
+	reader.close();
+
+	TermCounts file;
+	file.path = filepath;
+	file.counts.reserve(counter.terms().size());
+	for (auto term_index : counter.terms()) {
+		file.word_count += counter.count(term_index);
+	}
+	if (buckets > 0) {
+		// both signs of a bucket are next to each other once sorted, buckets that cancel out are left out
+		vector<uint32_t> ids(counter.terms());
+		sort(ids.begin(), ids.end());
+		for (auto id : ids) {
+			int count = (id & 1) ? -(int)counter.count(id) : (int)counter.count(id);
+			if (!file.counts.empty() && file.counts.back().first == id / 2) {
+				file.counts.back().second += count;
+				if (file.counts.back().second == 0) {
+					file.counts.pop_back();
+				}
+			} else {
+				file.counts.push_back(make_pair(id / 2, count));
+			}
+		}
+	} else {
+		for (auto term_index : counter.terms()) {
+			file.counts.push_back(make_pair(term_index, counter.count(term_index)));
 		}
 	}
+	counter.clear();
+	table.files.push_back(make_pair(position, std::move(file)));
     return true;
 }
 
-bool DocumentSet::processFileLocally(const string & filepath)
+void DocumentSet::mergeIngestionTables(vector<IngestionTable> & tables)
 {
-    static int file_count = 0;
-    if (options.verbose && options.have_stdout) {
-        cout << "\r" << "Processing file locally #" << (file_count + 1) << " " << filepath;
-    }
-	file_count++;
-	result = getUpdated(filepath);
-	int wc = 0;
-	for (auto & stats : result) {
-		wc += stats.second;
+	// (position, table, file) of every file, in the order they were walked
+	vector<tuple<uint64_t, unsigned, unsigned>> order;
+	for (unsigned t = 0, t_stop = tables.size(); t < t_stop; t++) {
+		for (unsigned f = 0, f_stop = tables[t].files.size(); f < f_stop; f++) {
+			order.push_back(make_tuple(tables[t].files[f].first, t, f));
+		}
+	}
+	sort(order.begin(), order.end());
+
+	// Terms are numbered in the order they're first seen when going through the files in the walk's order, so the
+	// result doesn't depend on which thread processed which file.
+	vector<vector<uint32_t>> global_index(tables.size());
+	for (unsigned t = 0, t_stop = tables.size(); t < t_stop; t++) {
+		global_index[t].resize(tables[t].terms.size(), TermDictionary::npos);
+	}
+	file_term_counts.reserve(file_term_counts.size() + order.size());
+	if (options.hash_dimensions > 0) {
+		// the buckets are already global, there are no terms to merge
+		vocabulary_freqs.resize(options.hash_dimensions, 0);
+		for (auto & item : order) {
+			TermCounts & file = tables[get<1>(item)].files[get<2>(item)].second;
+			for (auto & stats : file.counts) {
+				vocabulary_freqs[stats.first] += 1;
+			}
+			file_term_counts.push_back(std::move(file));
+		}
+		return;
 	}
-	vector<double> weights(Dimension);
-	for (auto & stats : result) {
-		auto it = file_statistics.find(stats.first);
-		if (it != file_statistics.end()) {
-			int global_word_freq = it->second.global_word_freq;
-			int global_word_index = it->second.global_word_index;
 
-			//stats.second is the files's term-frequency of the stats.first term
+	for (auto & item : order) {
+		unsigned t = get<1>(item);
+		TermCounts & file = tables[t].files[get<2>(item)].second;
+		for (auto & stats : file.counts) {
+			uint32_t & global = global_index[t][stats.first];
+			if (global == TermDictionary::npos) {
+				global = vocabulary.intern(tables[t].terms.data(stats.first), tables[t].terms.length(stats.first));
+				if (global == vocabulary_freqs.size()) {
+					vocabulary_freqs.push_back(0);
+				}
+			}
+			vocabulary_freqs[global] += 1;//stats.second if not doing per file level...
+			stats.first = global;
+		}
+		file_term_counts.push_back(std::move(file));
+	}
+}
+
+void DocumentSet::processFileLocally(const TermCounts & file, const vector<int> & pruned_index)
+{
+	double file_count = total_count;
+	//index, weight pairs, only for the terms that survived pruning
+	vector<pair<unsigned, weight_t>> weights;
+	weights.reserve(file.counts.size());
+	for (auto & stats : file.counts) {
+		int global_word_index = pruned_index[stats.first];
+		if (global_word_index != -1) {
+			int global_word_freq = dimension_freqs[global_word_index];
+
+			//stats.second is the files's term-frequency of the term
 
 			//try: idf(t) = 1 + log(numDocs / (docFreq + 1))
-			double tf = (double)stats.second / (double)wc;
-			double idf = 1 + log((double)file_count / ((double)global_word_freq + 1.0));
+			double tf = (double)stats.second / (double)file.word_count;
+			double idf = 1 + log(file_count / ((double)global_word_freq + 1.0));
 			double weighting = tf * idf;
-			weights[global_word_index] = weighting;// / (double)result.size();
-			MaxDimensions[global_word_index] = max(MaxDimensions[global_word_index], weights[global_word_index]);
+			weights.push_back(make_pair(global_word_index, weighting));// / (double)result.size();
+			MaxDimensions[global_word_index] = max(MaxDimensions[global_word_index], (weight_t)weighting);
 		}
 	}
-	documents.push_back(Document { filepath, weights });
-    return true;
+	//the terms were numbered in the order they were first seen, the sparse layout needs them ordered by dimension
+	sort(weights.begin(), weights.end());
+	vector<unsigned> indices(weights.size());
+	vector<weight_t> values(weights.size());
+	for (unsigned i = 0, stop = weights.size(); i < stop; i++) {
+		indices[i] = weights[i].first;
+		values[i] = weights[i].second;
+	}
+	documents.add(file.path, indices.data(), values.data(), indices.size());
 }
 
-map<string, int> DocumentSet::getUpdated(const string & filepath)
+string DocumentSet::wordFromIndex(unsigned index) const
 {
-    std::ifstream ifs(filepath, ios::in | ios::binary | ios::ate);
-    uint64_t sz = static_cast<uint64_t>(ifs.tellg());//read whole file for now... TODO: limit this later on
-    ifs.seekg(0, ios::beg);
-    vector<char> bytes(sz);
-    ifs.read(&bytes[0], sz);
-    ifs.close();
-
-    //hack because all my test Enron docs have a boilerplate disclaimer
-    string updated = boost::regex_replace(string(&bytes[0], sz), enronRegex, [] (const smatch & m) -> string { return ""; });
-
-    vector<string> result;
-    boost::algorithm::split_regex(result, updated, tfidfRegex);
-
-    map<string, int> processed;
-    for (string & line : result) {
-        string tmp = boost::regex_replace(line, outerPunctRegex, [] (const smatch & m) -> string { return ""; });
-        if (tmp.length() > 0) {
-            std::transform(tmp.begin(), tmp.end(), tmp.begin(), ::tolower);
-            if (boost::regex_match(tmp, validTokenRegex)) {
-                Porter2Stemmer::stem(tmp);
-                if (stop_words.find(tmp) == stop_words.end() && tmp.size() > 1) {
-                    if (processed.find(tmp) == processed.end()) {
-                        processed[tmp] = 1;
-                    } else {
-                        processed[tmp] += 1;
-                    }
-                }
-            } else {
-                vector<string> split_words;
-                boost::algorithm::split_regex(split_words, tmp, nonWordRegex);
-                for (string & split_line : split_words) {
-                    Porter2Stemmer::stem(split_line);
-                    if (stop_words.find(split_line) == stop_words.end() && split_line.size() > 1) {
-                        if (processed.find(split_line) == processed.end()) {
-                            processed[split_line] = 1;
-                        } else {
-                            processed[split_line] += 1;
-                        }
-                    }
-                }
-            }
-        }
-    }
-    return processed;
+	if (index < dimension_terms.size()) {
+		return vocabulary.term(dimension_terms[index]);
+	}
+	return "";
 }
 
-string DocumentSet::wordFromIndex(unsigned index)
+vector<pair<string, double>> DocumentSet::topTerms(const vector<weight_t> & centroid, unsigned k) const
 {
-	for (auto & stats : file_statistics) {
-		if (stats.second.global_word_index == index) {
-			return stats.first;
-		}
+	vector<unsigned> dimensions(centroid.size());
+	iota(dimensions.begin(), dimensions.end(), 0);
+	k = min(k, (unsigned)dimensions.size());
+	// ties go to the lower dimension, so the report doesn't depend on the selection's order
+	auto heavier = [&centroid] (unsigned a, unsigned b) {
+		return centroid[a] > centroid[b] || (centroid[a] == centroid[b] && a < b);
+	};
+	// selecting the top k first, then only sorting them, is O(Dimension + k log k)
+	nth_element(dimensions.begin(), dimensions.begin() + k, dimensions.end(), heavier);
+	sort(dimensions.begin(), dimensions.begin() + k, heavier);
+
+	vector<pair<string, double>> terms;
+	for (unsigned i = 0; i < k; i++) {
+		terms.push_back(make_pair(wordFromIndex(dimensions[i]), centroid[dimensions[i]]));
 	}
-	return "NO WORD FOUND!";
+	return terms;
 }
+
@@ -4,7 +4,11 @@
 #include "global.h"
 #include "parse_cmd_args.h"
 #include "document.h"
-#include "porter2_stemmer.h" //3rd party
+#include "document_matrix.h"
+#include "bounded_queue.h"
+#include "file_reader.h"
+#include "term_dictionary.h"
+#include "tokenizer.h"
 
 #include <assert.h>
 #include <stdint.h>
@@ -12,11 +16,18 @@
 
 #include <algorithm>
 #include <cmath>
+#include <functional>
+#include <iomanip>
 #include <iostream>
+#include <limits>
 #include <random>
 #include <string>
 #include <map>
+#include <mutex>
+#include <numeric>
+#include <thread>
 #include <vector>
+#include <unordered_map>
 #include <unordered_set>
 
 #define BOOST_NO_CXX11_SCOPED_ENUMS // fixes linker error when compiling on Linux
@@ -29,17 +40,35 @@
 using namespace std;
 using namespace boost;
 
-struct Stats {
-	unsigned global_word_freq = 0;
-	unsigned global_word_index = 0;
+// The term counts of a file, kept from reading it (see processFileGlobally()) until the vocabulary is final and its
+// weights can be calculated (see processFileLocally()).
+struct TermCounts {
+	string path;
+	unsigned word_count = 0;
+	// global_word_index, count pairs (bucket, signed count pairs with Options::hash_dimensions)
+	vector<pair<unsigned, int>> counts;
+};
 
-	Stats() {}
+// A file's size and modification time when it was listed, telling whether it changed since it was cached
+struct FileStamp {
+	int64_t size = -1;
+	int64_t modified_seconds = -1;
+	int64_t modified_nanoseconds = -1;
 
-	Stats(unsigned tmp_global_word_freq, unsigned tmp_global_word_index) :
-		global_word_freq(tmp_global_word_freq), global_word_index(tmp_global_word_index) {}
+	bool operator==(const FileStamp & other) const {
+		return size == other.size && modified_seconds == other.modified_seconds
+		       && modified_nanoseconds == other.modified_nanoseconds;
+	}
+};
 
-	Stats(const Stats & stat) :
-		global_word_freq(stat.global_word_freq), global_word_index(stat.global_word_index) {}
+// The terms and files seen by one ingestion thread (see processPaths()), until they're merged into the vocabulary
+struct IngestionTable {
+	// the terms numbered by local index
+	TermDictionary terms;
+	// counts the terms of the file being processed
+	TermCounter counter;
+	// the position of each file in the walk, and its term counts by local index
+	vector<pair<uint64_t, TermCounts>> files;
 };
 
 class DocumentSet {
@@ -58,43 +87,115 @@ public:
      */
     void runClustering();
     unsigned int size() const { return documents.size(); }
+    // Documents are views into the set (see DocumentMatrix), so accessing one never copies its path or weights
     Document operator  [](unsigned long index) const { return documents[index]; }
-    Document & operator [](const unsigned long index) { return documents[index]; }
+    DocumentMatrix::const_iterator begin() const { return documents.begin(); }
+    DocumentMatrix::const_iterator end() const { return documents.end(); }
+
+    // The term of a dimension, empty for the iris and wine data sets (which have no terms)
+    string wordFromIndex(unsigned index) const;
+    /**
+     * The k highest weighted terms of a centroid (e.g. to label its cluster), highest first.
+     *
+     * @param   const vector<weight_t> &    centroid
+     * @param   unsigned                    k
+     * @return  vector<pair<string, double>>    term, weight pairs
+     */
+    vector<pair<string, double>> topTerms(const vector<weight_t> & centroid, unsigned k) const;
+
+    /**
+     * Replaces the documents with a sparse random projection of them to fewer dimensions (see
+     * document_set_projection.cpp), keeping the originals to measure the clusters against. Sets Dimension and
+     * MaxDimensions to those of the projection, and prints how well it preserves the distances between documents.
+     *
+     * @param   unsigned    dimensions  must be less than Dimension
+     */
+    void reduceDimensions(unsigned dimensions);
+    bool isReduced() const { return !original_documents.empty(); }
+    unsigned originalDimension() const { return original_dimension; }
+    /**
+     * The mean of the original documents of each cluster (or of the documents, if they haven't been reduced).
+     *
+     * @param   const vector<int> &     clusters    the cluster of each document
+     * @param   unsigned                cluster_count
+     * @return  vector<vector<weight_t>>    dense centroids, of the original dimension
+     */
+    vector<vector<weight_t>> originalCentroids(const vector<int> & clusters, unsigned cluster_count) const;
+    // The fitness of centroids (see FitnessEngine) measured against the original documents
+    double originalFitness(const vector<vector<weight_t>> & centroids) const;
 
 private:
     Options options;
 
-    // Left-over hack from testing on Enron documents, which have a boilerplate disclaimer
-    boost::regex enronRegex {"\\*+[^\\*]+\\*+"};
-    boost::regex tfidfRegex {"[[:space:]]+|[()]|\\.{2,}"};
-    boost::regex outerPunctRegex {"^[^[:alpha:]]+|[^[:alpha:]]+$"};
-    boost::regex wordRegex {"[[:alpha:]]+"};
-    //boost::regex validTokenRegex {"^(?:[[:alpha:]\\.=&'\\-@]+[/#]*)+$|^[[:digit:]:]+^"};
-    boost::regex validTokenRegex {"^[[:alpha:]\\.=&'\\-@]+$|^[[:digit:]:]+^"};
-    boost::regex nonWordRegex {"[^[:alpha:]]"};
     boost::mt19937 generator {options.rand_seed};
     boost::random::uniform_int_distribution<> distribution;
     boost::random::uniform_int_distribution<uint64_t> distribution64;
     boost::mt19937_64 boost_generator64 {options.rand_seed};
 
-    //term, <global_word_freq, global_word_index>
-    map<string, Stats> file_statistics;
-    unordered_set<string> stop_words { "a", "the", "in", "to", "i", "he", "she", "it" };
+    // Every term seen, numbered by global_word_index, and the number of files containing each (global_word_freq).
+    // When hashing the terms, the vocabulary stays empty and the frequencies are those of the buckets.
+    TermDictionary vocabulary;
+    vector<unsigned> vocabulary_freqs;
+    // The global_word_index and global_word_freq of each dimension, i.e. of the terms left after pruning, in
+    // alphabetical order
+    vector<unsigned> dimension_terms;
+    vector<unsigned> dimension_freqs;
     unordered_set<string> amplified_words;
 
     // It may be preferable to use another random number generator in production, http://www.pcg-random.org/ lists
     // Mersenne Twister as having some failures for statistical quality.
     std::mt19937_64 std_generator64 {options.rand_seed};
 
-    uint64_t processPaths(string target_path, bool (DocumentSet::*f) (const string & filepath));
-    bool processFileGlobally(const string & filepath);
-    bool processFileLocally(const string & filepath);
-
-    string wordFromIndex(unsigned index);
-    map<string, int> getUpdated(const string & filepath);
-    vector<Document> documents;
+    // The files in the target_path directory (recursively), or listed in the target_path file
+    vector<string> listPaths(const string & target_path) const;
+    // Processes every file (on options.thread_count threads), adding to the vocabulary and file_term_counts, and
+    // returns how many could be processed
+    uint64_t processPaths(const vector<string> & paths);
+    // Processes the files that aren't cached (see readCachedTermCounts()), and puts every file's term counts in the
+    // order of paths
+    void processChangedPaths(const vector<string> & paths, const vector<bool> & cached);
+    // Drops the terms no file contains any more, renumbering the others
+    void compactVocabulary();
+    // Chooses the terms kept as dimensions (see Options), filling dimension_terms and dimension_freqs, and returns the
+    // dimension of each global_word_index (-1 when the term was pruned)
+    vector<int> pruneVocabulary();
+    // Reads and tokenizes a file, adding its terms and term counts to the calling thread's table (or, when hashing the
+    // terms, just its bucket counts)
+    bool processFileGlobally(uint64_t position, const string & filepath, IngestionTable & table,
+                             FileReader & reader, Tokenizer & tokenizer) const;
+    // Adds the tables' files to file_term_counts, in the order they were walked, and their terms to the vocabulary
+    void mergeIngestionTables(vector<IngestionTable> & tables);
+    // Weighs a file's term counts once the vocabulary is final, pruned_index maps each term's global_word_index
+    // from before pruning to its dimension (-1 when the term was pruned)
+    void processFileLocally(const TermCounts & file, const vector<int> & pruned_index);
+
+    // Exits unless there are enough documents to cluster
+    void checkDocumentCount() const;
+    // Quantizes the documents' weights (see DocumentMatrix::quantize()), printing the largest error
+    void quantizeDocuments();
+
+    // The binary cache of the document vectors, see document_set_cache.cpp
+    // The size and modification time of each file (a default FileStamp if it can't be stat'ed)
+    vector<FileStamp> stampFiles(const vector<string> & paths) const;
+    // Identifies the corpus by its paths, and each file's size and modification time (and the pruning options)
+    uint64_t corpusKey(const vector<string> & paths, const vector<FileStamp> & stamps) const;
+    // Fills the documents, vocabulary and MaxDimensions from the cache, returning false (having changed nothing) if
+    // it doesn't exist, isn't readable, or was written by another version or for another corpus
+    bool readCache(const string & cache_path, uint64_t corpus_key);
+    // Fills the vocabulary (before pruning) and file_term_counts, in the order of paths, from the cache's term
+    // counts of every file that hasn't changed since, marking them in cached. The files that were removed or changed
+    // are taken out of the term frequencies. Returns false (having changed nothing) if there's no usable cache.
+    bool readCachedTermCounts(const string & cache_path, const vector<string> & paths,
+                              const vector<FileStamp> & stamps, vector<bool> & cached);
+    bool writeCache(const string & cache_path, uint64_t corpus_key, const vector<string> & paths,
+                    const vector<FileStamp> & stamps) const;
+
+    DocumentMatrix documents;
+    // The documents before reduceDimensions(), and their Dimension, empty unless they were reduced
+    DocumentMatrix original_documents;
+    unsigned original_dimension = 0;
+    vector<TermCounts> file_term_counts;
     uint64_t total_count = 0;
-    map<string, int> result;
 
     vector<tuple<double, double, double, double, string>> irisData;
     vector<tuple<double, double, double, double, double, double, double, double, double, double, double, double, double, double>> wineData;
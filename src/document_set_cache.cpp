@@ -0,0 +1,437 @@
+#include "document_set.h"
+
+/*
+ * The cache is one binary file, in the machine's own byte order, that is memory-mapped when read:
+ *
+ *   CacheHeader
+ *   weight_t   max_dimensions[dimension]           MaxDimensions
+ *   uint32_t   dimension_freqs[dimension]
+ *   uint64_t   term_offsets[term_count + 1]        term i is term_chars[term_offsets[i], term_offsets[i + 1])
+ *   char       term_chars[term_bytes]
+ *   uint64_t   document_offsets[document_count + 1]
+ *   uint32_t   indices[nonzero_count]              document i is indices and values [offsets[i], offsets[i + 1])
+ *   weight_t   values[nonzero_count]
+ *   uint64_t   path_offsets[document_count + 1]
+ *   char       path_chars[path_bytes]
+ *
+ * followed by what is needed to update the documents when only some of the files changed (see
+ * readCachedTermCounts()), i.e. the state between processFileGlobally() and processFileLocally():
+ *
+ *   FileStamp  stamps[document_count]
+ *   uint32_t   word_counts[document_count]
+ *   uint64_t   count_offsets[document_count + 1]
+ *   uint32_t   count_terms[count_total]            document i's TermCounts are [offsets[i], offsets[i + 1])
+ *   int32_t    count_values[count_total]
+ *   uint32_t   vocabulary_freqs[freq_count]        the terms before pruning, count_terms index them
+ *   uint64_t   vocabulary_offsets[vocabulary_size + 1]
+ *   char       vocabulary_chars[vocabulary_bytes]
+ *
+ * with every section starting on a multiple of 8 bytes.
+ *
+ * When the terms are hashed (see Options::hash_dimensions) there are no terms: term_count and vocabulary_size are 0,
+ * and freq_count is the number of buckets.
+ */
+
+// Bump whenever the layout, or the way documents are turned into vectors, changes
+static const uint32_t cache_version = 4;
+static const char cache_magic[8] = { 'B', 'H', 'C', 'C', 'A', 'C', 'H', 'E' };
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t weight_size;   // sizeof(weight_t), as floats and doubles can't be mixed
+    uint64_t corpus_key;
+    uint64_t file_size;
+    uint64_t document_count;
+    uint64_t dimension;
+    uint64_t nonzero_count;
+    uint64_t term_count;
+    uint64_t term_bytes;
+    uint64_t path_bytes;
+    uint64_t count_total;
+    uint64_t vocabulary_size;
+    uint64_t vocabulary_bytes;
+    uint64_t hash_dimensions;
+};
+
+// The offset of each section, given the header's counts
+struct CacheLayout {
+    uint64_t max_dimensions, dimension_freqs, term_offsets, term_chars, document_offsets, indices, values,
+             path_offsets, path_chars, stamps, word_counts, count_offsets, count_terms, count_values,
+             vocabulary_freqs, vocabulary_offsets, vocabulary_chars, end;
+
+    static uint64_t freqCount(const CacheHeader & header) {
+        return header.hash_dimensions > 0 ? header.hash_dimensions : header.vocabulary_size;
+    }
+
+    CacheLayout(const CacheHeader & header) {
+        uint64_t offset = sizeof(CacheHeader);
+        max_dimensions = section(offset, header.dimension * sizeof(weight_t));
+        dimension_freqs = section(offset, header.dimension * sizeof(uint32_t));
+        term_offsets = section(offset, (header.term_count + 1) * sizeof(uint64_t));
+        term_chars = section(offset, header.term_bytes);
+        document_offsets = section(offset, (header.document_count + 1) * sizeof(uint64_t));
+        indices = section(offset, header.nonzero_count * sizeof(uint32_t));
+        values = section(offset, header.nonzero_count * sizeof(weight_t));
+        path_offsets = section(offset, (header.document_count + 1) * sizeof(uint64_t));
+        path_chars = section(offset, header.path_bytes);
+        stamps = section(offset, header.document_count * sizeof(FileStamp));
+        word_counts = section(offset, header.document_count * sizeof(uint32_t));
+        count_offsets = section(offset, (header.document_count + 1) * sizeof(uint64_t));
+        count_terms = section(offset, header.count_total * sizeof(uint32_t));
+        count_values = section(offset, header.count_total * sizeof(int32_t));
+        vocabulary_freqs = section(offset, freqCount(header) * sizeof(uint32_t));
+        vocabulary_offsets = section(offset, (header.vocabulary_size + 1) * sizeof(uint64_t));
+        vocabulary_chars = section(offset, header.vocabulary_bytes);
+        end = offset;
+    }
+
+private:
+    static uint64_t section(uint64_t & offset, uint64_t size) {
+        uint64_t start = offset;
+        offset = (offset + size + 7) & ~(uint64_t)7;
+        return start;
+    }
+};
+
+// Whether a table of count + 1 offsets starts at 0 and never decreases up to total, i.e. splits total items in order
+static bool validOffsets(const char* base, uint64_t offsets, uint64_t count, uint64_t total)
+{
+    const uint64_t* table = (const uint64_t*)(base + offsets);
+    if (table[0] != 0 || table[count] != total) {
+        return false;
+    }
+    for (uint64_t i = 0; i < count; i++) {
+        if (table[i] > table[i + 1]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Whether each of count indices is below limit
+static bool validIndices(const char* base, uint64_t indices, uint64_t count, uint64_t limit)
+{
+    const uint32_t* table = (const uint32_t*)(base + indices);
+    for (uint64_t i = 0; i < count; i++) {
+        if (table[i] >= limit) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Whether every offset and index of the cache stays within the section it points into, so a damaged (or edited) file
+// is rebuilt rather than read out of bounds
+static bool validCache(const char* base, const CacheHeader & header)
+{
+    CacheLayout layout(header);
+    return validOffsets(base, layout.term_offsets, header.term_count, header.term_bytes)
+           && validOffsets(base, layout.document_offsets, header.document_count, header.nonzero_count)
+           && validIndices(base, layout.indices, header.nonzero_count, header.dimension)
+           && validOffsets(base, layout.path_offsets, header.document_count, header.path_bytes)
+           && validOffsets(base, layout.count_offsets, header.document_count, header.count_total)
+           && validIndices(base, layout.count_terms, header.count_total, CacheLayout::freqCount(header))
+           && validOffsets(base, layout.vocabulary_offsets, header.vocabulary_size, header.vocabulary_bytes);
+}
+
+// Maps the cache, checking it was written by this version of the code with the same weight_t, and is intact
+static bool openCache(const string & cache_path, FileReader & reader, CacheHeader & header)
+{
+    if (!reader.open(cache_path) || reader.size() < sizeof(CacheHeader)) {
+        return false;
+    }
+    memcpy(&header, reader.begin(), sizeof(header));
+    if (memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 || header.version != cache_version
+        || header.weight_size != sizeof(weight_t) || header.file_size != reader.size()) {
+        return false;
+    }
+    // every item takes at least a byte, so counts no larger than the file can't overflow the layout's offsets
+    uint64_t counts[] = { header.document_count, header.dimension, header.nonzero_count, header.term_count,
+                          header.term_bytes, header.path_bytes, header.count_total, header.vocabulary_size,
+                          header.vocabulary_bytes, header.hash_dimensions };
+    for (uint64_t count : counts) {
+        if (count > reader.size()) {
+            return false;
+        }
+    }
+    return CacheLayout(header).end == reader.size() && validCache(reader.begin(), header);
+}
+
+// Adds the strings of a table of offsets and characters to dictionary, in order
+static void internCachedStrings(const char* base, uint64_t offsets, uint64_t chars, uint64_t count,
+                                TermDictionary & dictionary)
+{
+    const uint64_t* string_offsets = (const uint64_t*)(base + offsets);
+    for (uint64_t i = 0; i < count; i++) {
+        dictionary.intern(base + chars + string_offsets[i], string_offsets[i + 1] - string_offsets[i]);
+    }
+}
+
+// The i-th string of a table of offsets and characters
+static string cachedString(const char* base, uint64_t offsets, uint64_t chars, uint64_t i)
+{
+    const uint64_t* string_offsets = (const uint64_t*)(base + offsets);
+    return string(base + chars + string_offsets[i], base + chars + string_offsets[i + 1]);
+}
+
+// 64-bit FNV-1a
+static void hashBytes(uint64_t & hash, const void* data, unsigned long size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    for (unsigned long i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+}
+
+vector<FileStamp> DocumentSet::stampFiles(const vector<string> & paths) const
+{
+    vector<FileStamp> stamps(paths.size());
+    for (unsigned long i = 0, stop = paths.size(); i < stop; i++) {
+        struct stat info;
+        if (stat(paths[i].c_str(), &info) == 0) {
+            stamps[i].size = info.st_size;
+            stamps[i].modified_seconds = info.st_mtim.tv_sec;
+            stamps[i].modified_nanoseconds = info.st_mtim.tv_nsec;
+        }
+    }
+    return stamps;
+}
+
+uint64_t DocumentSet::corpusKey(const vector<string> & paths, const vector<FileStamp> & stamps) const
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned long i = 0, stop = paths.size(); i < stop; i++) {
+        hashBytes(hash, paths[i].c_str(), paths[i].size() + 1);
+        // files that can't be stat'ed (so can't be read either) still change the key when they appear
+        int64_t stamp[3] = { stamps[i].size, stamps[i].modified_seconds, stamps[i].modified_nanoseconds };
+        hashBytes(hash, stamp, sizeof(stamp));
+    }
+    // the cached vectors only hold the terms left after pruning
+    hashBytes(hash, &options.min_df, sizeof(options.min_df));
+    hashBytes(hash, &options.max_df, sizeof(options.max_df));
+    hashBytes(hash, &options.max_vocabulary, sizeof(options.max_vocabulary));
+    hashBytes(hash, &options.hash_dimensions, sizeof(options.hash_dimensions));
+    return hash;
+}
+
+bool DocumentSet::readCache(const string & cache_path, uint64_t corpus_key)
+{
+    FileReader reader;
+    CacheHeader header;
+    if (!openCache(cache_path, reader, header) || header.corpus_key != corpus_key) {
+        return false;
+    }
+    CacheLayout layout(header);
+    const char* base = reader.begin();
+
+    const weight_t* max_dimensions = (const weight_t*)(base + layout.max_dimensions);
+    const uint32_t* freqs = (const uint32_t*)(base + layout.dimension_freqs);
+    const uint64_t* document_offsets = (const uint64_t*)(base + layout.document_offsets);
+    const uint32_t* indices = (const uint32_t*)(base + layout.indices);
+    const weight_t* values = (const weight_t*)(base + layout.values);
+
+    Dimension = header.dimension; //global variables from global.h
+    MaxDimensions.assign(max_dimensions, max_dimensions + header.dimension);
+    dimension_freqs.assign(freqs, freqs + header.dimension);
+    // only the terms of the dimensions are cached, so they're the whole vocabulary (empty when hashing the terms)
+    vocabulary.clear();
+    internCachedStrings(base, layout.term_offsets, layout.term_chars, header.term_count, vocabulary);
+    vocabulary_freqs.assign(freqs, freqs + header.dimension);
+    dimension_terms.resize(header.term_count);
+    iota(dimension_terms.begin(), dimension_terms.end(), 0);
+
+    documents.clear();
+    documents.reserve(header.document_count, header.nonzero_count);
+    for (uint64_t i = 0; i < header.document_count; i++) {
+        documents.add(cachedString(base, layout.path_offsets, layout.path_chars, i), indices + document_offsets[i],
+                      values + document_offsets[i], document_offsets[i + 1] - document_offsets[i]);
+    }
+    total_count = header.document_count;
+    return true;
+}
+
+bool DocumentSet::readCachedTermCounts(const string & cache_path, const vector<string> & paths,
+                                       const vector<FileStamp> & stamps, vector<bool> & cached)
+{
+    FileReader reader;
+    CacheHeader header;
+    // term counts and bucket counts can't be mixed
+    if (!openCache(cache_path, reader, header) || header.hash_dimensions != options.hash_dimensions) {
+        return false;
+    }
+    CacheLayout layout(header);
+    const char* base = reader.begin();
+
+    const FileStamp* cached_stamps = (const FileStamp*)(base + layout.stamps);
+    const uint32_t* word_counts = (const uint32_t*)(base + layout.word_counts);
+    const uint64_t* count_offsets = (const uint64_t*)(base + layout.count_offsets);
+    const uint32_t* count_terms = (const uint32_t*)(base + layout.count_terms);
+    const int32_t* count_values = (const int32_t*)(base + layout.count_values);
+    const uint32_t* cached_freqs = (const uint32_t*)(base + layout.vocabulary_freqs);
+
+    unordered_map<string, uint64_t> cached_documents;
+    for (uint64_t i = 0; i < header.document_count; i++) {
+        cached_documents.insert(make_pair(cachedString(base, layout.path_offsets, layout.path_chars, i), i));
+    }
+
+    vocabulary.clear();
+    internCachedStrings(base, layout.vocabulary_offsets, layout.vocabulary_chars, header.vocabulary_size, vocabulary);
+    vocabulary_freqs.assign(cached_freqs, cached_freqs + CacheLayout::freqCount(header));
+
+    file_term_counts.clear();
+    cached.assign(paths.size(), false);
+    vector<unsigned> uses(header.document_count, 0);
+    for (unsigned long p = 0, stop = paths.size(); p < stop; p++) {
+        auto it = cached_documents.find(paths[p]);
+        if (it == cached_documents.end() || !(cached_stamps[it->second] == stamps[p])) {
+            continue;
+        }
+        uint64_t i = it->second;
+        TermCounts file;
+        file.path = paths[p];
+        file.word_count = word_counts[i];
+        file.counts.reserve(count_offsets[i + 1] - count_offsets[i]);
+        for (uint64_t c = count_offsets[i], c_stop = count_offsets[i + 1]; c < c_stop; c++) {
+            file.counts.push_back(make_pair(count_terms[c], count_values[c]));
+        }
+        file_term_counts.push_back(std::move(file));
+        cached[p] = true;
+        uses[i]++;
+    }
+
+    // The cached frequencies count each cached file once, so only the files that are gone (or changed, and will be
+    // counted again when they're processed) or listed more than once need their terms' frequencies adjusting.
+    for (uint64_t i = 0; i < header.document_count; i++) {
+        if (uses[i] == 1) {
+            continue;
+        }
+        for (uint64_t c = count_offsets[i], c_stop = count_offsets[i + 1]; c < c_stop; c++) {
+            if (uses[i] == 0) {
+                vocabulary_freqs[count_terms[c]] -= 1;
+            } else {
+                vocabulary_freqs[count_terms[c]] += uses[i] - 1;
+            }
+        }
+    }
+    return true;
+}
+
+bool DocumentSet::writeCache(const string & cache_path, uint64_t corpus_key, const vector<string> & paths,
+                             const vector<FileStamp> & stamps) const
+{
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = cache_version;
+    header.weight_size = sizeof(weight_t);
+    header.corpus_key = corpus_key;
+    header.document_count = documents.size();
+    header.dimension = Dimension;
+    header.term_count = dimension_terms.size();
+    header.vocabulary_size = vocabulary.size();
+    header.hash_dimensions = options.hash_dimensions;
+
+    // (characters, length) of the terms in dimension order, the vocabulary in index order, and the paths
+    vector<pair<const char*, uint64_t>> terms, vocabulary_terms, document_paths;
+    for (auto term_index : dimension_terms) {
+        terms.push_back(make_pair(vocabulary.data(term_index), vocabulary.length(term_index)));
+        header.term_bytes += terms.back().second;
+    }
+    for (uint32_t i = 0, stop = vocabulary.size(); i < stop; i++) {
+        vocabulary_terms.push_back(make_pair(vocabulary.data(i), vocabulary.length(i)));
+        header.vocabulary_bytes += vocabulary_terms.back().second;
+    }
+    header.nonzero_count = documents.nonZeroCount();
+    for (unsigned long d = 0, d_stop = documents.size(); d < d_stop; d++) {
+        const string & path = documents.path(d);
+        document_paths.push_back(make_pair(path.data(), path.size()));
+        header.path_bytes += path.size();
+    }
+    for (auto & file : file_term_counts) {
+        header.count_total += file.counts.size();
+    }
+    CacheLayout layout(header);
+    header.file_size = layout.end;
+
+    // every document came from a listed file, in the same order
+    vector<FileStamp> document_stamps;
+    document_stamps.reserve(documents.size());
+    for (unsigned long p = 0, stop = paths.size(); p < stop && document_stamps.size() < documents.size(); p++) {
+        if (paths[p] == documents.path(document_stamps.size())) {
+            document_stamps.push_back(stamps[p]);
+        }
+    }
+
+    // written to a temporary file first, so an interrupted run never leaves a truncated cache behind
+    string temporary_path = cache_path + ".tmp";
+    std::ofstream out(temporary_path, ios::out | ios::binary | ios::trunc);
+    auto write = [&] (uint64_t offset, const void* data, uint64_t size) {
+        static const char padding[8] = {};
+        if (!out) {
+            return;
+        }
+        out.write(padding, offset - (uint64_t)out.tellp());
+        out.write((const char*)data, size);
+    };
+    auto write_strings = [&] (uint64_t offsets_offset, uint64_t chars_offset,
+                              const vector<pair<const char*, uint64_t>> & strings) {
+        vector<uint64_t> offsets(1, 0);
+        for (auto & s : strings) {
+            offsets.push_back(offsets.back() + s.second);
+        }
+        write(offsets_offset, offsets.data(), offsets.size() * sizeof(uint64_t));
+        write(chars_offset, nullptr, 0);
+        for (auto & s : strings) {
+            out.write(s.first, s.second);
+        }
+    };
+
+    write(0, &header, sizeof(header));
+    write(layout.max_dimensions, MaxDimensions.data(), Dimension * sizeof(weight_t));
+    vector<uint32_t> freqs(dimension_freqs.begin(), dimension_freqs.end());
+    write(layout.dimension_freqs, freqs.data(), freqs.size() * sizeof(uint32_t));
+    write_strings(layout.term_offsets, layout.term_chars, terms);
+
+    // the documents' arrays are already laid out as the cache's are
+    const vector<uint64_t> & document_offsets = documents.documentOffsets();
+    write(layout.document_offsets, document_offsets.data(), document_offsets.size() * sizeof(uint64_t));
+    write(layout.indices, documents.indexData(), documents.nonZeroCount() * sizeof(uint32_t));
+    write(layout.values, documents.valueData(), documents.nonZeroCount() * sizeof(weight_t));
+
+    write_strings(layout.path_offsets, layout.path_chars, document_paths);
+
+    write(layout.stamps, document_stamps.data(), document_stamps.size() * sizeof(FileStamp));
+    vector<uint32_t> word_counts;
+    vector<uint64_t> offsets(1, 0);
+    for (auto & file : file_term_counts) {
+        word_counts.push_back(file.word_count);
+        offsets.push_back(offsets.back() + file.counts.size());
+    }
+    write(layout.word_counts, word_counts.data(), word_counts.size() * sizeof(uint32_t));
+    write(layout.count_offsets, offsets.data(), offsets.size() * sizeof(uint64_t));
+    write(layout.count_terms, nullptr, 0);
+    for (auto & file : file_term_counts) {
+        for (auto & count : file.counts) {
+            out.write((const char*)&count.first, sizeof(uint32_t));
+        }
+    }
+    write(layout.count_values, nullptr, 0);
+    for (auto & file : file_term_counts) {
+        for (auto & count : file.counts) {
+            out.write((const char*)&count.second, sizeof(int32_t));
+        }
+    }
+    vector<uint32_t> freqs_by_index(vocabulary_freqs.begin(), vocabulary_freqs.end());
+    write(layout.vocabulary_freqs, freqs_by_index.data(), freqs_by_index.size() * sizeof(uint32_t));
+    write_strings(layout.vocabulary_offsets, layout.vocabulary_chars, vocabulary_terms);
+    write(layout.end, nullptr, 0);
+    out.close();
+
+    if (!out || document_stamps.size() != documents.size()
+        || std::rename(temporary_path.c_str(), cache_path.c_str()) != 0) {
+        std::remove(temporary_path.c_str());
+        return false;
+    }
+    return true;
+}
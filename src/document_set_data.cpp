@@ -8,11 +8,12 @@ void DocumentSet::initIris()
 
     for (unsigned i = 0; i < irisData.size(); i++) {
         string filepath = get<4>(irisData[i]) + "-" + to_string(i);
-        vector<double> weights = { get<0>(irisData[i]), get<1>(irisData[i]), get<2>(irisData[i]), get<3>(irisData[i]) };
+        vector<double> data = { get<0>(irisData[i]), get<1>(irisData[i]), get<2>(irisData[i]), get<3>(irisData[i]) };
+        vector<weight_t> weights(data.begin(), data.end());
         for (int j = 0; j < 4; j++) {
             MaxDimensions[j] = max(MaxDimensions[j], weights[j]);
         }
-        documents.push_back(Document { filepath, weights });
+        documents.add(filepath, weights);
     }
 
     cout << "Using iris data." << endl;
@@ -26,14 +27,15 @@ void DocumentSet::initWine()
 
     for (unsigned i = 0; i < wineData.size(); i++) {
         string filepath = to_string(get<0>(wineData[i]));
-        vector<double> weights = { get<1>(wineData[i]), get<2>(wineData[i]), get<3>(wineData[i]), get<4>(wineData[i]),
+        vector<double> data = { get<1>(wineData[i]), get<2>(wineData[i]), get<3>(wineData[i]), get<4>(wineData[i]),
                 get<5>(wineData[i]), get<6>(wineData[i]), get<7>(wineData[i]), get<8>(wineData[i]), get<9>(wineData[i]),
                 get<10>(wineData[i]), get<11>(wineData[i]), get<12>(wineData[i]), get<13>(wineData[i])
         };
+        vector<weight_t> weights(data.begin(), data.end());
         for (int j = 0; j < 13; j++) {
             MaxDimensions[j] = max(MaxDimensions[j], weights[j]);
         }
-        documents.push_back(Document { filepath, weights });
+        documents.add(filepath, weights);
     }
 
     cout << "Using wine data." << endl;
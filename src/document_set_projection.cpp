@@ -0,0 +1,150 @@
+#include "document_set.h"
+
+/*
+ * A sparse random projection (a sparse Johnson-Lindenstrauss transform): every original dimension is sent to
+ * projection_nonzeros different random dimensions of the projection, with a random sign and a weight of
+ * 1 / sqrt(projection_nonzeros). Squared distances are then preserved in expectation, with an error that shrinks as the
+ * projection gets larger, and projecting a document only costs projection_nonzeros operations per non-zero term.
+ */
+static const unsigned projection_nonzeros = 4;
+
+// The number of random document pairs used to measure how well the projection preserves distances
+static const unsigned distortion_samples = 1000;
+
+// |a - b|^2 of two documents of the same space, visiting only their non-zero terms
+static double squaredDistance(const Document & a, const Document & b)
+{
+    double dot_product = 0.0;
+    for (unsigned long i = 0, j = 0, i_stop = a.nonZeroCount(), j_stop = b.nonZeroCount(); i < i_stop && j < j_stop; ) {
+        if (a.indices[i] < b.indices[j]) {
+            i++;
+        } else if (a.indices[i] > b.indices[j]) {
+            j++;
+        } else {
+            dot_product += a.weight(i++) * b.weight(j++);
+        }
+    }
+    return max(a.squared_norm + b.squared_norm - 2.0 * dot_product, 0.0);
+}
+
+void DocumentSet::reduceDimensions(unsigned dimensions)
+{
+    unsigned nonzeros = min(projection_nonzeros, dimensions);
+    double scale = 1.0 / sqrt((double)nonzeros);
+
+    // targets[d * nonzeros + n] is the n-th dimension original dimension d is sent to, signs[] its sign
+    vector<unsigned> targets((unsigned long)Dimension * nonzeros);
+    vector<int8_t> signs(targets.size());
+    uniform_int_distribution<unsigned> target_distribution(0, dimensions - 1);
+    for (unsigned long d = 0, d_stop = Dimension; d < d_stop; d++) {
+        unsigned* dimension_targets = &targets[d * nonzeros];
+        for (unsigned n = 0; n < nonzeros; n++) {
+            do {
+                dimension_targets[n] = target_distribution(std_generator64);
+            } while (find(dimension_targets, dimension_targets + n, dimension_targets[n]) != dimension_targets + n);
+            signs[d * nonzeros + n] = (std_generator64() & 1) ? 1 : -1;
+        }
+    }
+
+    DocumentMatrix projected;
+    projected.reserve(documents.size(), min(documents.size() * dimensions, documents.nonZeroCount() * nonzeros));
+    vector<double> sums(dimensions);
+    vector<weight_t> weights(dimensions);
+    for (Document document : documents) {
+        fill(sums.begin(), sums.end(), 0.0);
+        for (unsigned long i = 0, stop = document.nonZeroCount(); i < stop; i++) {
+            double weight = document.weight(i) * scale;
+            unsigned long first = (unsigned long)document.indices[i] * nonzeros;
+            for (unsigned n = 0; n < nonzeros; n++) {
+                sums[targets[first + n]] += signs[first + n] * weight;
+            }
+        }
+        copy(sums.begin(), sums.end(), weights.begin());
+        projected.add(*document.path, weights);
+    }
+
+    // how much the distances between random pairs of documents change
+    double total_distortion = 0.0;
+    double max_distortion = 0.0;
+    unsigned pair_count = 0;
+    if (documents.size() > 1) {
+        uniform_int_distribution<unsigned long> document_distribution(0, documents.size() - 1);
+        for (unsigned s = 0; s < distortion_samples; s++) {
+            unsigned long a = document_distribution(std_generator64);
+            unsigned long b = document_distribution(std_generator64);
+            double original = squaredDistance(documents[a], documents[b]);
+            if (a == b || original == 0.0) {
+                continue;
+            }
+            double distortion = fabs(sqrt(squaredDistance(projected[a], projected[b]) / original) - 1.0);
+            total_distortion += distortion;
+            max_distortion = max(max_distortion, distortion);
+            pair_count++;
+        }
+    }
+
+    original_dimension = Dimension;
+    original_documents.swap(documents);
+    documents.swap(projected);
+    Dimension = dimensions; //global variables from global.h
+    MaxDimensions.assign(dimensions, 0);
+    for (Document document : documents) {
+        for (unsigned long i = 0, stop = document.nonZeroCount(); i < stop; i++) {
+            MaxDimensions[document.indices[i]] = max(MaxDimensions[document.indices[i]], (weight_t)document.weight(i));
+        }
+    }
+    if (options.quantize) {
+        quantizeDocuments();
+    }
+
+    cout << "Projected " << original_dimension << " dimensions to " << dimensions << ", distances between "
+         << pair_count << " random pairs of documents changed by " << setprecision(3)
+         << (pair_count ? 100.0 * total_distortion / pair_count : 0.0) << "% on average, "
+         << 100.0 * max_distortion << "% at most." << setprecision(32) << endl;
+}
+
+vector<vector<weight_t>> DocumentSet::originalCentroids(const vector<int> & clusters, unsigned cluster_count) const
+{
+    const DocumentMatrix & originals = isReduced() ? original_documents : documents;
+    unsigned dimension = isReduced() ? original_dimension : Dimension;
+
+    vector<vector<double>> sums(cluster_count, vector<double>(dimension, 0.0));
+    vector<unsigned long> sizes(cluster_count, 0);
+    for (unsigned long d = 0, d_stop = originals.size(); d < d_stop; d++) {
+        Document document = originals[d];
+        vector<double> & sum = sums[clusters[d]];
+        for (unsigned long i = 0, stop = document.nonZeroCount(); i < stop; i++) {
+            sum[document.indices[i]] += document.weight(i);
+        }
+        sizes[clusters[d]]++;
+    }
+
+    vector<vector<weight_t>> centroids(cluster_count, vector<weight_t>(dimension));
+    for (unsigned c = 0; c < cluster_count; c++) {
+        for (unsigned i = 0; i < dimension && sizes[c] > 0; i++) {
+            centroids[c][i] = sums[c][i] / sizes[c];
+        }
+    }
+    return centroids;
+}
+
+double DocumentSet::originalFitness(const vector<vector<weight_t>> & centroids) const
+{
+    const DocumentMatrix & originals = isReduced() ? original_documents : documents;
+    unsigned dimension = isReduced() ? original_dimension : Dimension;
+
+    vector<double> squared_norms;
+    for (auto & centroid : centroids) {
+        squared_norms.push_back(Document::squaredNorm(centroid));
+    }
+    double total_distance = 0.0;
+    for (Document document : originals) {
+        double min_squared_distance = numeric_limits<double>::max();
+        for (unsigned long j = 0, j_stop = centroids.size(); j < j_stop; j++) {
+            min_squared_distance = min(min_squared_distance,
+                                       document.squared_norm + squared_norms[j] - 2.0 * document.dotProduct(centroids[j]));
+        }
+        total_distance += sqrt(max(min_squared_distance, 0.0) / dimension);
+    }
+    return total_distance;
+}
@@ -0,0 +1,68 @@
+#include "file_reader.h"
+
+bool FileReader::open(const string & filepath)
+{
+    close();
+    int fd = ::open(filepath.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == -1 || S_ISDIR(info.st_mode)) {
+        ::close(fd);
+        return false;
+    }
+
+    bool success = true;
+    if (S_ISREG(info.st_mode) && (unsigned long)info.st_size >= mmap_threshold) {
+        void* address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED) {
+            madvise(address, info.st_size, MADV_SEQUENTIAL);
+            mapping = address;
+            contents = (const char*)address;
+            contents_size = info.st_size;
+        } else {
+            success = readAll(fd, info.st_size);
+        }
+    } else {
+        // the size of pipes and the like isn't known up front
+        success = readAll(fd, S_ISREG(info.st_mode) ? info.st_size : 0);
+    }
+    ::close(fd);
+    return success;
+}
+
+void FileReader::close()
+{
+    if (mapping) {
+        munmap(mapping, contents_size);
+        mapping = nullptr;
+    }
+    contents = nullptr;
+    contents_size = 0;
+}
+
+bool FileReader::readAll(int fd, unsigned long size_hint)
+{
+    unsigned long used = 0;
+    buffer.resize(max(buffer.size(), max(size_hint + 1, 4096ul)));
+    while (true) {
+        if (used == buffer.size()) {
+            buffer.resize(2 * buffer.size());
+        }
+        ssize_t count = read(fd, buffer.data() + used, buffer.size() - used);
+        if (count == 0) {
+            break;
+        } else if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        used += count;
+    }
+    contents = buffer.data();
+    contents_size = used;
+    return true;
+}
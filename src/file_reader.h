@@ -0,0 +1,56 @@
+#ifndef FILE_READER
+#define FILE_READER
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Gives read-only access to the whole contents of a file, without copying it when it's large enough: regular files of
+ * at least mmap_threshold bytes are memory-mapped (and advised as read sequentially), anything else (small files,
+ * pipes, ...) is read into a buffer that is reused by the next open().
+ *
+ * Mapping and unmapping a file costs more than reading a few pages, so tiny files are cheaper to read.
+ */
+class FileReader {
+public:
+    static const unsigned long mmap_threshold = 64 * 1024;
+
+    FileReader() {}
+    FileReader(const FileReader &) = delete;
+    FileReader & operator=(const FileReader &) = delete;
+    ~FileReader() { close(); }
+
+    /**
+     * Opens filepath, replacing the previously opened file's contents.
+     *
+     * @return  bool    false if the file couldn't be read (its contents are then empty)
+     */
+    bool open(const string & filepath);
+    // Releases the contents (unmapping the file if it was mapped)
+    void close();
+
+    // The file's contents are [begin(), end()), valid until the next open() or close()
+    const char* begin() const { return contents; }
+    const char* end() const { return contents + contents_size; }
+    unsigned long size() const { return contents_size; }
+    bool isMapped() const { return mapping != nullptr; }
+
+private:
+    bool readAll(int fd, unsigned long size_hint);
+
+    void* mapping = nullptr;
+    vector<char> buffer;
+    const char* contents = nullptr;
+    unsigned long contents_size = 0;
+};
+
+#endif //FILE_READER
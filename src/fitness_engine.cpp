@@ -0,0 +1,5 @@
+#include "fitness_engine.h"
+
+// The engine is defined in fitness_engine.h so --benchmark can run it on other Documents (see runBenchmarks()), but
+// the one the stars use is only compiled here
+template class BasicFitnessEngine<DocumentSet>;
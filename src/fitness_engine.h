@@ -0,0 +1,420 @@
+#ifndef FITNESS_ENGINE
+#define FITNESS_ENGINE
+
+#include "global.h"
+#include "parse_cmd_args.h"
+#include "document.h"
+#include "document_set.h"
+#include "centroid_matrix.h"
+#include "thread_pool.h"
+
+#include <vector>
+#include <iostream>
+#include <limits>
+
+using namespace std;
+
+/**
+ * What a star knows about its documents from its last evaluation (see FitnessEngine::evaluateBounded()): the closest
+ * centroid of each document and the distance to it (as it's counted in the fitness), and a lower bound on the
+ * (euclidean) distance to every other centroid, stored as a float rounded down so it stays a bound.
+ *
+ * There's no upper bound on the distance to the closest centroid, as Hamerly's k-means keeps, because that distance
+ * is needed for the fitness anyway, so it's always measured exactly before the lower bound is checked against it.
+ */
+struct DistanceBounds {
+    vector<unsigned> nearest;
+    vector<double> distance;
+    vector<float> lower;
+    bool valid = false;
+};
+
+/**
+ * Scores a set of centroids against every document of a DocumentSet, i.e. the sum over all documents of the distance
+ * to the closest centroid.
+ *
+ * Rather than measuring each (document, centroid) pair directly, it expands the euclidean distance into
+ * |d|^2 + |c|^2 - 2 d.c, where |d|^2 is cached by every Document and |c|^2 by the caller (see Star). The d.c terms are
+ * evaluated one block of documents at a time, centroid by centroid (a sparse dot product per pair), so each centroid
+ * is only streamed through the cache once per block rather than once per document.
+ *
+ * The documents are split into fixed-size shards which are scored on the thread pool, and the per-shard sums are then
+ * added up in shard order. As the shards don't depend on the number of threads, neither does the fitness (bit for bit).
+ *
+ * Given a sample of the documents (see Options::batch_size), only those are scored, and the sum is scaled up to
+ * estimate the fitness over every document.
+ *
+ * As stars only move part of the way towards the black hole, most documents keep the same closest centroid from one
+ * evaluation to the next. evaluateBounded() uses the triangle inequality (as in Hamerly's k-means) to skip measuring
+ * the other centroids of those documents, giving exactly the same fitness as evaluate().
+ *
+ * Documents is the DocumentSet (see FitnessEngine), or anything else with its size() and an operator[]() returning a
+ * Document, such as the copying one --benchmark times the DocumentSet's views against.
+ */
+template <typename Documents>
+class BasicFitnessEngine {
+public:
+    BasicFitnessEngine(const Options & options, const Documents* docset, ThreadPool* thread_pool);
+
+    /**
+     * @param   const CentroidMatrix &              centroids
+     * @param   const vector<double> &              squared_norms   |c|^2 of each centroid
+     * @param   const vector<unsigned>*             sample          indices of the documents to score, or nullptr for
+     *                                                              all of them
+     * @return  double                              the fitness (lower is better)
+     */
+    double evaluate(const CentroidMatrix & centroids, const vector<double> & squared_norms,
+                    const vector<unsigned>* sample = nullptr) const;
+
+    /**
+     * The same fitness as evaluate() over every document, using and updating bounds.
+     *
+     * @param   const CentroidMatrix &              centroids
+     * @param   const vector<double> &              squared_norms   |c|^2 of each centroid
+     * @param   const vector<double> &              shifts          how far each centroid moved since bounds were
+     *                                                              last updated (ignored unless bounds.valid)
+     * @param   DistanceBounds &                    bounds
+     * @return  double                              the fitness (lower is better)
+     */
+    double evaluateBounded(const CentroidMatrix & centroids, const vector<double> & squared_norms,
+                           const vector<double> & shifts, DistanceBounds & bounds) const;
+
+    /**
+     * The document closest to each centroid, given the bounds of a full evaluation of the same centroids. Only the
+     * documents whose lower bound doesn't rule them out are measured against the centroids they're not closest to.
+     *
+     * @param   const CentroidMatrix &              centroids
+     * @param   const vector<double> &              squared_norms   |c|^2 of each centroid
+     * @param   const DistanceBounds &              bounds
+     * @return  vector<unsigned long>                               the index of the document closest to each centroid
+     */
+    vector<unsigned long> nearestDocuments(const CentroidMatrix & centroids,
+                                           const vector<double> & squared_norms, const DistanceBounds & bounds) const;
+
+    // The reference implementation, summing (w - c)^2 over every dimension of every (document, centroid) pair, with
+    // neither the cached norms nor the distance kernels
+    double evaluateDirect(const CentroidMatrix & centroids) const;
+
+    static const unsigned block_size = 64;
+    static const unsigned shard_size = 16 * block_size;
+    // The margin (relative to the squared norms involved) by which bounds must show a centroid is the closest
+    static constexpr double bound_tolerance = 1e-9;
+
+private:
+    // sum of the distances of documents [shard_start, shard_stop) (of the sample, if any) to their closest centroid
+    double evaluateShard(const CentroidMatrix & centroids, const vector<double> & squared_norms,
+                         const vector<unsigned>* sample, unsigned long shard_start, unsigned long shard_stop) const;
+
+    /**
+     * d.c for each of a block of documents and every centroid, centroid by centroid, so each centroid is streamed
+     * through the cache once per block.
+     *
+     * @param   const CentroidMatrix &              centroids
+     * @param   unsigned long                       count           the number of documents, at most block_size
+     * @param   DocIndex                            doc_index       the index in the DocumentSet of the b-th document
+     * @return  const double*                                       d.c of the b-th document and centroid j at
+     *                                                              [b * centroids.size() + j], in a buffer of the
+     *                                                              calling thread's that the next call overwrites
+     */
+    template <typename DocIndex>
+    const double* blockDotProducts(const CentroidMatrix & centroids, unsigned long count, DocIndex doc_index) const {
+        unsigned long centroid_count = centroids.size();
+        // one buffer per thread, so scoring stops allocating once every thread has scored a shard
+        static thread_local vector<double> dot_products;
+        dot_products.resize(block_size * centroid_count);
+
+        for (unsigned long j = 0; j < centroid_count; j++) {
+            const weight_t* centroid = centroids[j];
+            for (unsigned long b = 0; b < count; b++) {
+                dot_products[b * centroid_count + j] = (*docset)[doc_index(b)].dotProduct(centroid);
+            }
+        }
+        return dot_products.data();
+    }
+
+    // Checks the fitness against evaluateDirect() if check_fitness is set
+    void checkFitness(const CentroidMatrix & centroids, double fitness) const;
+
+    const Documents* docset;
+    ThreadPool* thread_pool;
+    bool check_fitness = false;
+    double fitness_tolerance = 0.0;
+    // the sum of each shard's distances, kept between evaluations so they don't allocate
+    mutable vector<double> shard_distances;
+};
+
+// The engine the stars score themselves with
+typedef BasicFitnessEngine<DocumentSet> FitnessEngine;
+// instantiated once, in fitness_engine.cpp
+extern template class BasicFitnessEngine<DocumentSet>;
+
+template <typename Documents>
+BasicFitnessEngine<Documents>::BasicFitnessEngine(const Options & options, const Documents* docset,
+                                                  ThreadPool* thread_pool)
+    : docset(docset),
+      thread_pool(thread_pool),
+      check_fitness(options.check_fitness),
+      fitness_tolerance(options.fitness_tolerance)
+{
+}
+
+template <typename Documents>
+double BasicFitnessEngine<Documents>::evaluate(const CentroidMatrix & centroids,
+                                               const vector<double> & squared_norms,
+                                               const vector<unsigned>* sample) const
+{
+    unsigned long doc_count = sample ? sample->size() : docset->size();
+    unsigned long shard_count = (doc_count + shard_size - 1) / shard_size;
+    shard_distances.assign(shard_count, 0.0);
+
+    thread_pool->parallelFor(shard_count, [&] (unsigned long shard) {
+        unsigned long shard_start = shard * shard_size;
+        shard_distances[shard] = evaluateShard(centroids, squared_norms, sample,
+                                               shard_start, min(shard_start + shard_size, doc_count));
+    });
+
+    double total_distance = 0.0;
+    for (double shard_distance : shard_distances) {
+        total_distance += shard_distance;
+    }
+    if (sample) {
+        return doc_count > 0 ? total_distance * docset->size() / doc_count : 0.0;
+    }
+
+    checkFitness(centroids, total_distance);
+    return total_distance;
+}
+
+template <typename Documents>
+void BasicFitnessEngine<Documents>::checkFitness(const CentroidMatrix & centroids, double fitness) const
+{
+    if (check_fitness) {
+        double direct = evaluateDirect(centroids);
+        double difference = fabs(direct - fitness);
+        if (difference > fitness_tolerance * max(1.0, fabs(direct))) {
+            cout << "Fitness mismatch: " << fitness << " (expected " << direct
+                 << ", difference " << difference << ")" << endl;
+        }
+    }
+}
+
+// The float closest to x that is no larger than it
+static inline float roundDown(double x)
+{
+    float f = (float)x;
+    return f > x ? nextafterf(f, -numeric_limits<float>::infinity()) : f;
+}
+
+template <typename Documents>
+double BasicFitnessEngine<Documents>::evaluateBounded(const CentroidMatrix & centroids,
+                                                      const vector<double> & squared_norms,
+                                                      const vector<double> & shifts, DistanceBounds & bounds) const
+{
+    unsigned long doc_count = docset->size();
+    unsigned long centroid_count = centroids.size();
+    bool use_bounds = bounds.valid && bounds.nearest.size() == doc_count;
+    if (!use_bounds) {
+        bounds.nearest.resize(doc_count);
+        bounds.distance.resize(doc_count);
+        bounds.lower.resize(doc_count);
+    }
+
+    // A document's lower bound shrinks by the furthest any other centroid moved, i.e. the largest shift, unless the
+    // document's own centroid moved furthest, then the second largest.
+    unsigned long furthest = 0;
+    double largest_shift = 0.0, second_largest_shift = 0.0;
+    for (unsigned long j = 0; use_bounds && j < centroid_count; j++) {
+        if (shifts[j] > largest_shift) {
+            second_largest_shift = largest_shift;
+            largest_shift = shifts[j];
+            furthest = j;
+        } else if (shifts[j] > second_largest_shift) {
+            second_largest_shift = shifts[j];
+        }
+    }
+    double max_squared_norm = *max_element(squared_norms.begin(), squared_norms.end());
+
+    unsigned long shard_count = (doc_count + shard_size - 1) / shard_size;
+    shard_distances.assign(shard_count, 0.0);
+    thread_pool->parallelFor(shard_count, [&] (unsigned long shard) {
+        unsigned long shard_start = shard * shard_size, shard_stop = min(shard_start + shard_size, doc_count);
+        // the documents the bounds can't settle, measured against every centroid once the shard has been walked
+        static thread_local vector<unsigned long> unpruned;
+        unpruned.clear();
+
+        for (unsigned long i = shard_start; i < shard_stop; i++) {
+            if (use_bounds) {
+                Document doc = (*docset)[i];
+                double doc_squared_norm = doc.squared_norm;
+                unsigned nearest = bounds.nearest[i];
+                double lower = bounds.lower[i] - (nearest == furthest ? second_largest_shift : largest_shift);
+                // The rounding errors of the computed squared distances are far smaller than the margin, so the
+                // nearest centroid is the one evaluate() would find, and its distance is calculated the same way.
+                if (lower > 0.0) {
+                    double squared_distance = max(doc_squared_norm + squared_norms[nearest]
+                                                  - 2.0 * doc.dotProduct(centroids[nearest]), 0.0);
+                    if (lower * lower - squared_distance > bound_tolerance * (doc_squared_norm + max_squared_norm)) {
+                        bounds.distance[i] = sqrt(squared_distance / Dimension);
+                        bounds.lower[i] = roundDown(lower);
+                        continue;
+                    }
+                }
+            }
+            unpruned.push_back(i);
+        }
+
+        // the rest go through the same blocked document x centroid product as evaluate()
+        for (unsigned long block_start = 0; block_start < unpruned.size(); block_start += block_size) {
+            unsigned long block_stop = min(block_start + block_size, (unsigned long)unpruned.size());
+            const double* dot_products = blockDotProducts(centroids, block_stop - block_start, [&] (unsigned long b) {
+                return unpruned[block_start + b];
+            });
+
+            for (unsigned long b = 0; b < block_stop - block_start; b++) {
+                unsigned long i = unpruned[block_start + b];
+                double doc_squared_norm = (*docset)[i].squared_norm;
+                const double* doc_dot_products = &dot_products[b * centroid_count];
+                double min_squared_distance = numeric_limits<double>::max();
+                double second_squared_distance = numeric_limits<double>::max();
+                unsigned nearest = 0;
+                for (unsigned long j = 0; j < centroid_count; j++) {
+                    double squared_distance = doc_squared_norm + squared_norms[j] - 2.0 * doc_dot_products[j];
+                    if (squared_distance < min_squared_distance) {
+                        second_squared_distance = min_squared_distance;
+                        min_squared_distance = squared_distance;
+                        nearest = j;
+                    } else if (squared_distance < second_squared_distance) {
+                        second_squared_distance = squared_distance;
+                    }
+                }
+                bounds.distance[i] = sqrt(max(min_squared_distance, 0.0) / Dimension);
+                bounds.nearest[i] = nearest;
+                // with a single centroid there's no other one to be closer
+                bounds.lower[i] = centroid_count > 1 ? roundDown(sqrt(max(second_squared_distance, 0.0)))
+                                                     : numeric_limits<float>::infinity();
+            }
+        }
+
+        // summed in document order, as evaluate() does
+        double total_distance = 0.0;
+        for (unsigned long i = shard_start; i < shard_stop; i++) {
+            total_distance += bounds.distance[i];
+        }
+        shard_distances[shard] = total_distance;
+    });
+    bounds.valid = true;
+
+    double total_distance = 0.0;
+    for (double shard_distance : shard_distances) {
+        total_distance += shard_distance;
+    }
+    checkFitness(centroids, total_distance);
+    return total_distance;
+}
+
+template <typename Documents>
+double BasicFitnessEngine<Documents>::evaluateShard(const CentroidMatrix & centroids,
+                                                    const vector<double> & squared_norms,
+                                                    const vector<unsigned>* sample, unsigned long shard_start,
+                                                    unsigned long shard_stop) const
+{
+    unsigned long centroid_count = centroids.size();
+    double total_distance = 0.0;
+
+    for (unsigned long block_start = shard_start; block_start < shard_stop; block_start += block_size) {
+        unsigned long block_stop = min(block_start + block_size, shard_stop);
+        const double* dot_products = blockDotProducts(centroids, block_stop - block_start, [&] (unsigned long b) {
+            return sample ? (unsigned long)(*sample)[block_start + b] : block_start + b;
+        });
+
+        for (unsigned long i = block_start; i < block_stop; i++) {
+            double doc_squared_norm = (*docset)[sample ? (*sample)[i] : i].squared_norm;
+            double min_squared_distance = numeric_limits<double>::max();
+            const double* doc_dot_products = &dot_products[(i - block_start) * centroid_count];
+
+            for (unsigned long j = 0; j < centroid_count; j++) {
+                double squared_distance = doc_squared_norm + squared_norms[j] - 2.0 * doc_dot_products[j];
+                if (squared_distance < min_squared_distance) {
+                    min_squared_distance = squared_distance;
+                }
+            }
+            // cancellation can leave a tiny negative value when the document sits on a centroid
+            total_distance += sqrt(max(min_squared_distance, 0.0) / Dimension);
+        }
+    }
+    return total_distance;
+}
+
+template <typename Documents>
+vector<unsigned long> BasicFitnessEngine<Documents>::nearestDocuments(const CentroidMatrix & centroids,
+                                                                      const vector<double> & squared_norms,
+                                                                      const DistanceBounds & bounds) const
+{
+    unsigned long doc_count = docset->size();
+    unsigned long centroid_count = centroids.size();
+    vector<unsigned long> nearest_docs(centroid_count, doc_count);
+    vector<double> nearest_distances(centroid_count, numeric_limits<double>::max());
+
+    // the distance of every document to its own centroid is already known
+    for (unsigned long i = 0; i < doc_count; i++) {
+        unsigned nearest = bounds.nearest[i];
+        if (bounds.distance[i] <= nearest_distances[nearest]) {
+            nearest_distances[nearest] = bounds.distance[i];
+            nearest_docs[nearest] = i;
+        }
+    }
+
+    // any other centroid is at least bounds.lower[i] away, which is usually further than its closest document so far
+    for (unsigned long i = 0; i < doc_count; i++) {
+        Document doc = (*docset)[i];
+        double lower = bounds.lower[i];
+        for (unsigned long j = 0; j < centroid_count; j++) {
+            double nearest_distance = nearest_distances[j] * sqrt((double)Dimension);
+            if (j == bounds.nearest[i] || (lower > nearest_distance && lower * lower - nearest_distance * nearest_distance
+                                           > bound_tolerance * (doc.squared_norm + squared_norms[j]))) {
+                continue;
+            }
+            double distance = doc.documentDistance(centroids[j], squared_norms[j]);
+            if (distance <= nearest_distances[j]) {
+                nearest_distances[j] = distance;
+                nearest_docs[j] = i;
+            }
+        }
+    }
+    return nearest_docs;
+}
+
+template <typename Documents>
+double BasicFitnessEngine<Documents>::evaluateDirect(const CentroidMatrix & centroids) const
+{
+    double total_distance = 0.0;
+    // each document expanded to all Dimension weights, zeroed again after use
+    vector<weight_t> weights(Dimension, 0);
+
+    for (unsigned long i = 0, doc_count = docset->size(); i < doc_count; i++) {
+        Document doc = (*docset)[i];
+        doc.toDense(weights.data());
+        double min_distance = numeric_limits<double>::max();
+
+        for (unsigned long j = 0, j_stop = centroids.size(); j < j_stop; j++) {
+            const weight_t* centroid = centroids[j];
+            double sum = 0.0;
+            for (int d = 0; d < Dimension; d++) {
+                double difference = (double)weights[d] - centroid[d];
+                sum += difference * difference;
+            }
+            double distance = sqrt(sum / Dimension);
+
+            if (distance < min_distance) {
+                min_distance = distance;
+            }
+        }
+        total_distance += min_distance;
+        for (unsigned long k = 0; k < doc.nonZeroCount(); k++) {
+            weights[doc.indices[k]] = 0;
+        }
+    }
+    return total_distance;
+}
+
+#endif //FITNESS_ENGINE
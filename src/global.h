@@ -4,8 +4,16 @@
 #include <vector>
 using namespace std;
 
+// The type used to store document weights and centroids, build with "make PRECISION=float" to halve the memory (and
+// memory traffic) they take up. Distances are still accumulated in double precision either way.
+#ifdef SINGLE_PRECISION
+typedef float weight_t;
+#else
+typedef double weight_t;
+#endif
+
 // These variables are set in clustering.h
 extern int Dimension;
-extern vector<double> MaxDimensions;
+extern vector<weight_t> MaxDimensions;
 
 #endif //GLOBAL
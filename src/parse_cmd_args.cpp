@@ -1,4 +1,5 @@
 #include "parse_cmd_args.h"
+#include "distance_kernels.h"
 
 Options processCmdLineArgs(int argc, char **argv)
 {
@@ -9,11 +10,37 @@ Options processCmdLineArgs(int argc, char **argv)
         ("centroids,c", value<int>()->default_value(options.centroid_count), "Set the number of centroids to use.")
         ("stars,a", value<int>()->default_value(options.particle_count), "Set the number of stars to use.")
         ("iterations,i", value<int>()->default_value(options.num_iterations), "Set the number of iterations to run.")
-        ("random-seed,m", "Set the random number seed to use.")
+        ("random-seed,m", value<unsigned>(), "Set the random number seed to use.")
+        ("threads,t", value<int>()->default_value(options.thread_count), "Set the number of threads to use.")
         ("path,p", value<vector<string>>(),
          "Directory containing, or path of file listing the paths, of documents to cluster.")
+        ("cache", value<string>(), "Binary cache of the --path document vectors: read if the documents haven't "
+                                   "changed since it was written, otherwise updated by only processing the new and "
+                                   "changed documents.")
         ("iris,s", "Use the iris data set.")
         ("wine,w", "Use the wine data set.")
+        ("simd", value<string>(), "Set the distance kernels to use: scalar, sse2, avx2 or avx512 (defaults to the "
+                                  "fastest the CPU supports).")
+        ("benchmark", "Run the distance kernel micro-benchmarks (and the tokenizer benchmark on the --path "
+                      "documents, if given).")
+        ("min-df", value<int>()->default_value(options.min_df),
+         "Drop the terms found in fewer documents.")
+        ("max-df", value<double>()->default_value(options.max_df),
+         "Drop the terms found in a larger fraction of the documents.")
+        ("max-vocabulary", value<int>()->default_value(options.max_vocabulary),
+         "Keep at most this many of the most frequent terms (0 for no limit).")
+        ("hash-dims", value<int>()->default_value(options.hash_dimensions),
+         "Hash the terms into this many dimensions instead of building a vocabulary (0 for off).")
+        ("reduce-dims", value<int>()->default_value(options.reduce_dimensions),
+         "Randomly project the documents to this many dimensions before clustering (0 for none).")
+        ("batch-size", value<int>()->default_value(options.batch_size),
+         "Score the stars on this many randomly sampled documents each iteration (0 for all of them).")
+        ("quantize", "Store document weights as 8-bit integers (less accurate, but faster).")
+        ("check-fitness", "Check every fitness against the direct euclidean calculation.")
+        ("fitness-tolerance", value<double>()->default_value(options.fitness_tolerance, "1e-6"),
+         "Relative fitness difference allowed by --check-fitness.")
+        ("top-terms", value<int>()->default_value(options.top_terms),
+         "Set the number of highest weighted terms reported for each centroid (0 for none).")
         ("verbose,v", "Verbose output (including file-names and times).")
         ("quiet,q", "Quiet mode, only outputting basic statistics.");
     variables_map vm;
@@ -61,16 +88,123 @@ Options processCmdLineArgs(int argc, char **argv)
         }
     }
 
-    options.rand_seed = vm.count("random_seed") ?
-                        (unsigned)vm["random_seed"].as<int>() : system_clock::now().time_since_epoch().count();
+    if (vm.count("simd")) {
+        options.simd = vm["simd"].as<string>();
+    }
+    if (!selectKernels(options.simd)) {
+        options.perform_run = false;
+        cout << "The --simd kernels " << options.simd << " are not supported by this CPU" << endl;
+    }
+
+    if (vm.count("min-df")) {
+        if (vm["min-df"].as<int>() < 0) {
+            options.perform_run = false;
+            cout << "Need a --min-df value >= 0" << endl;
+        } else {
+            options.min_df = vm["min-df"].as<int>();
+        }
+    }
+
+    if (vm.count("max-df")) {
+        if (vm["max-df"].as<double>() <= 0 || vm["max-df"].as<double>() > 1) {
+            options.perform_run = false;
+            cout << "Need a --max-df value > 0 and <= 1" << endl;
+        } else {
+            options.max_df = vm["max-df"].as<double>();
+        }
+    }
+
+    if (vm.count("max-vocabulary")) {
+        if (vm["max-vocabulary"].as<int>() < 0) {
+            options.perform_run = false;
+            cout << "Need a --max-vocabulary value >= 0" << endl;
+        } else {
+            options.max_vocabulary = vm["max-vocabulary"].as<int>();
+        }
+    }
+
+    if (vm.count("hash-dims")) {
+        // each thread's TermCounter is indexed by twice the bucket (see DocumentSet::processFileGlobally()), so this
+        // keeps it at 32 MB
+        if (vm["hash-dims"].as<int>() < 0 || vm["hash-dims"].as<int>() > (1 << 22)) {
+            options.perform_run = false;
+            cout << "Need a --hash-dims value between 0 and " << (1 << 22) << endl;
+        } else {
+            options.hash_dimensions = vm["hash-dims"].as<int>();
+        }
+    }
+
+    if (vm.count("reduce-dims")) {
+        if (vm["reduce-dims"].as<int>() < 0) {
+            options.perform_run = false;
+            cout << "Need a --reduce-dims value >= 0" << endl;
+        } else {
+            options.reduce_dimensions = vm["reduce-dims"].as<int>();
+        }
+    }
+
+    if (vm.count("batch-size")) {
+        if (vm["batch-size"].as<int>() < 0) {
+            options.perform_run = false;
+            cout << "Need a --batch-size value >= 0" << endl;
+        } else {
+            options.batch_size = vm["batch-size"].as<int>();
+        }
+    }
+
+    if (vm.count("quantize")) {
+        options.quantize = true;
+    }
+
+    if (vm.count("check-fitness")) {
+        options.check_fitness = true;
+    }
+
+    if (vm.count("top-terms")) {
+        if (vm["top-terms"].as<int>() < 0) {
+            options.perform_run = false;
+            cout << "Need a --top-terms value >= 0" << endl;
+        } else {
+            options.top_terms = vm["top-terms"].as<int>();
+        }
+    }
+
+    if (vm.count("fitness-tolerance")) {
+        if (vm["fitness-tolerance"].as<double>() < 0) {
+            options.perform_run = false;
+            cout << "Need a --fitness-tolerance value >= 0" << endl;
+        } else {
+            options.fitness_tolerance = vm["fitness-tolerance"].as<double>();
+        }
+    }
+
+    if (vm.count("threads")) {
+        if (vm["threads"].as<int>() <= 0) {
+            options.perform_run = false;
+            cout << "Need a --threads value > 0" << endl;
+        } else {
+            options.thread_count = vm["threads"].as<int>();
+        }
+    }
+
+    options.rand_seed = vm.count("random-seed") ?
+                        vm["random-seed"].as<unsigned>() : system_clock::now().time_since_epoch().count();
     srand(options.rand_seed);
 
-    if (vm.count("path") + vm.count("iris") + vm.count("wine") > 1) {
+    if (vm.count("benchmark")) {
+        options.benchmark = true;
+        if (vm.count("path")) {
+            options.path = vm["path"].as< vector<string> >()[0];
+        }
+    } else if (vm.count("path") + vm.count("iris") + vm.count("wine") > 1) {
         options.perform_run = false;
         cout << "Can only specify one of --path, --iris, or --wine" << endl;
     } else if (vm.count("path") && (is_directory(vm["path"].as< vector<string> >()[0])
                                || is_regular_file(vm["path"].as< vector<string> >()[0]))) {
         options.path = vm["path"].as< vector<string> >()[0];
+        if (vm.count("cache")) {
+            options.cache_path = vm["cache"].as<string>();
+        }
     } else if (vm.count("iris")) {
         options.iris = true;
     } else if (vm.count("wine")) {
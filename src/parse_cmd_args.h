@@ -3,6 +3,7 @@
 
 #include <chrono>
 #include <iostream>
+#include <thread>
 #include <vector>
 #include <string>
 
@@ -27,9 +28,13 @@ using namespace boost::program_options;
 struct Options {
     bool perform_run = true;
     string path;
+    // binary cache of the path's document vectors (see document_set_cache.cpp), empty for none
+    string cache_path;
     //test data, see document_set_data.cpp
     bool iris = false;
     bool wine = false;
+    // Run the micro-benchmarks (see benchmark.cpp) rather than clustering
+    bool benchmark = false;
     // Control amount of program output
     bool verbose = false;
     bool quiet = false;
@@ -38,6 +43,10 @@ struct Options {
     // the output is redirected to a file, so this is used to detect and avoid that problem.
     bool have_stdout = isatty(fileno(stdout));
     unsigned rand_seed = 3725841767;
+    // number of threads used to evaluate the stars, results don't depend on it
+    unsigned thread_count = max(1u, std::thread::hardware_concurrency());
+    // distance kernels to use (see distance_kernels.h), empty for the fastest the CPU supports
+    string simd;
 
     // Particle Swarm Optimization algorithm
     unsigned particle_count = 10;   // number of particles
@@ -47,6 +56,24 @@ struct Options {
     // Black Hole algorithm
     unsigned star_count = 20;
     unsigned centroid_count = 4;    // number of centroids in each star
+
+    // Vocabulary pruning (see DocumentSet::pruneVocabulary())
+    unsigned min_df = 2;                // terms found in fewer documents are dropped
+    double max_df = 1.0;                // terms found in a larger fraction of the documents are dropped
+    unsigned max_vocabulary = 0;        // the most frequent terms kept, 0 for no limit
+    // Feature hashing: the number of dimensions terms are hashed into, with no vocabulary and no pruning, 0 for off
+    unsigned hash_dimensions = 0;
+    // Random projection of the documents to this many dimensions before clustering, 0 for none
+    unsigned reduce_dimensions = 0;
+
+    // Fitness evaluation
+    unsigned batch_size = 0;            // documents sampled to score the stars each iteration, 0 for all of them
+    bool quantize = false;              // store document weights as 8-bit integers
+    bool check_fitness = false;         // compare each fitness against the direct euclidean calculation
+    double fitness_tolerance = 1e-6;    // relative difference allowed by check_fitness
+
+    // Report
+    unsigned top_terms = 0;             // highest weighted terms reported for each centroid
 };
 
 /**
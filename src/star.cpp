@@ -1,58 +1,127 @@
 #include "star.h"
 
-Star::Star(std::mt19937_64* std_generator64, const Options & options, const DocumentSet* docset, int index)
+/**
+ * Chooses k different numbers from [0, n) uniformly at random, in random order, with Floyd's algorithm: O(k) draws
+ * rather than shuffling all n of them. The numbers chosen so far are kept in an open-addressing set (in slots, a buffer
+ * reused between calls), so checking each draw against them is O(1) expected.
+ */
+static void sampleWithoutReplacement(unsigned long n, unsigned k, std::mt19937_64 & generator,
+                                     vector<unsigned long> & chosen, vector<unsigned long> & slots)
+{
+    assert(k <= n);
+    // a power of two at least twice k, with n marking an empty slot
+    unsigned slot_bits = 1;
+    while ((1ul << slot_bits) < 2ul * k) {
+        slot_bits++;
+    }
+    unsigned long slot_mask = (1ul << slot_bits) - 1;
+    slots.assign(slot_mask + 1, n);
+    // adds t to the set, unless it's already there
+    auto insert = [&] (unsigned long t) {
+        unsigned long slot = (t * 0x9e3779b97f4a7c15ull) >> (64 - slot_bits);
+        while (slots[slot] != n) {
+            if (slots[slot] == t) {
+                return false;
+            }
+            slot = (slot + 1) & slot_mask;
+        }
+        slots[slot] = t;
+        return true;
+    };
+
+    chosen.clear();
+    for (unsigned long j = n - k; j < n; j++) {
+        unsigned long t = uniform_int_distribution<unsigned long>(0, j)(generator);
+        if (!insert(t)) {
+            // j is new, as every number chosen so far is below it
+            insert(j);
+            t = j;
+        }
+        chosen.push_back(t);
+    }
+    // Floyd's algorithm picks every subset equally often, but j is chosen more often late than early
+    shuffle(chosen.begin(), chosen.end(), generator);
+}
+
+Star::Star(std::mt19937_64* std_generator64, const Options & options, const DocumentSet* docset, int index,
+           ThreadPool* thread_pool, const vector<unsigned>* sample)
         : options(options),
-          boost_generator64{(*std_generator64)()},
           docset(docset),
-          is_black_hole(false)
+          fitness_engine(options, docset, thread_pool)
 {
-    vector<int> uniform_random_selection(docset->size());
+    respawn(std_generator64, sample);
+}
 
-    for (int i = 0, stop = docset->size(); i < stop; i++) {
-        uniform_random_selection[i] = i;
-    }
-    shuffle(uniform_random_selection.begin(), uniform_random_selection.end(), *std_generator64);
+void Star::respawn(std::mt19937_64* std_generator64, const vector<unsigned>* sample)
+{
+    boost_generator64.seed((*std_generator64)());
+    is_black_hole = false;
 
+    sampleWithoutReplacement(docset->size(), options.centroid_count, *std_generator64, seed_documents, seed_slots);
+    current_position.resize(options.centroid_count, Dimension);
     for(unsigned i = 0; i < options.centroid_count; i++) {
-        current_position.push_back((*docset)[uniform_random_selection[i]].weights);
+        (*docset)[seed_documents[i]].toDense(current_position[i]);
     }
-    update_fitness();
+    // the documents' bounds were for the old centroids
+    bounds.valid = false;
+    update_fitness(sample);
 }
 
 /**
  * xi(t + 1) = xi(t) + rand() * (xBH - xi(t)) i = 1,2,...,N
+ *
+ * Each centroid takes one draw from the star's generator, seeding the stream of random coefficients its dimensions
+ * move by (see DistanceKernels::move_towards), which also measures the centroid's shift and new norm as it goes.
  */
-void Star::move_towards_black_hole(const vector<vector<double>> & black_hole_position)
+void Star::move_towards_black_hole(const CentroidMatrix & black_hole_position,
+                                   const vector<unsigned>* sample)
 {
     if (!is_black_hole) {
+        shifts.resize(options.centroid_count);
+        squared_norms.resize(options.centroid_count);
         for (unsigned i = 0; i < options.centroid_count; i++) {
-            for (int j = 0; j < Dimension; j++) {
-                current_position[i][j] += get_random() * (black_hole_position[i][j] - current_position[i][j]);
-            }
+            // the shift is measured from the stored values, so rounding can't make it smaller than the real one
+            double squared_shift = Kernels.move_towards(current_position[i], black_hole_position[i], Dimension,
+                                                        (uint32_t)boost_generator64(), &squared_norms[i]);
+            shifts[i] = sqrt(squared_shift);
         }
-        update_fitness();
+        score(sample);
     }
     if (options.verbose) {
         //cout<< "fitness: " << current_fitness << endl;
     }
 }
 
-void Star::update_fitness()
+void Star::update_fitness(const vector<unsigned>* sample)
 {
-    double total_distance = 0.0;
-
-    for (int i = 0, i_stop = docset->size(); i < i_stop; i++) {
-        double min_distance = numeric_limits<double>::max();
-        const Document & doc = (*docset)[i];
+    squared_norms.resize(current_position.size());
+    for (int j = 0, j_stop = current_position.size(); j < j_stop; j++) {
+        squared_norms[j] = Document::squaredNorm(current_position[j]);
+    }
+    score(sample);
+}
 
-        for (int j = 0, j_stop = current_position.size(); j < j_stop; j++) {
-            double distance = doc.documentDistance(current_position[j]);
+void Star::score(const vector<unsigned>* sample)
+{
+    if (sample) {
+        // the documents outside the sample weren't measured, so the bounds no longer hold
+        current_fitness = fitness_engine.evaluate(current_position, squared_norms, sample);
+        bounds.valid = false;
+    } else {
+        current_fitness = fitness_engine.evaluateBounded(current_position, squared_norms, shifts, bounds);
+    }
+    shifts.assign(current_position.size(), 0.0);
+}
 
-            if (distance < min_distance) {
-                min_distance = distance;
-            }
-        }
-        total_distance += min_distance;
+const DistanceBounds & Star::get_assignment()
+{
+    if (!bounds.valid) {
+        update_fitness();
     }
-    current_fitness = total_distance;
+    return bounds;
+}
+
+vector<unsigned long> Star::get_centroid_documents()
+{
+    return fitness_engine.nearestDocuments(current_position, squared_norms, get_assignment());
 }
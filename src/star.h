@@ -3,6 +3,7 @@
 
 #include "document.h"
 #include "document_set.h"
+#include "fitness_engine.h"
 
 #include <stdint.h>
 #include <vector>
@@ -14,24 +15,49 @@ using namespace std;
 
 class Star {
 public:
-    Star(std::mt19937_64* std_generator64, const Options & options, const DocumentSet* docset, int index);
-
-    void move_towards_black_hole(const vector<vector<double>> & black_hole_position);
+    // sample: if given, the star's fitness is only estimated from these documents (see FitnessEngine)
+    Star(std::mt19937_64* std_generator64, const Options & options, const DocumentSet* docset, int index,
+         ThreadPool* thread_pool, const vector<unsigned>* sample = nullptr);
+
+    // Starts the star again from options.centroid_count random documents, reusing its buffers (so the stars of a
+    // BlackHoleAlgorithm are a pool that never reallocates when they cross the event horizon)
+    void respawn(std::mt19937_64* std_generator64, const vector<unsigned>* sample = nullptr);
+    void move_towards_black_hole(const CentroidMatrix & black_hole_position,
+                                 const vector<unsigned>* sample = nullptr);
+    // Scores the star's current position against the sample of documents, or every document if there's none
+    void update_fitness(const vector<unsigned>* sample = nullptr);
     double get_current_fitness() { return current_fitness; }
-    vector<vector<double>>* get_position() { return &current_position; }
+    // Replaces the fitness without re-scoring the star (e.g. with its sample estimate after a full evaluation)
+    void set_current_fitness(double fitness) { current_fitness = fitness; }
+    // The closest centroid of each document and the distance to it (see DistanceBounds), re-scoring the star on every
+    // document if it was last scored on a sample
+    const DistanceBounds & get_assignment();
+    // The index of the document closest to each centroid
+    vector<unsigned long> get_centroid_documents();
+    CentroidMatrix* get_position() { return &current_position; }
     void set_black_hole() { is_black_hole = true; }
     void set_not_black_hole() { is_black_hole = false; }
 
 private:
-    void update_fitness();
-
-    vector<vector<double>> current_position;
+    CentroidMatrix current_position;
+    // the documents current_position was last started from (see respawn())
+    vector<unsigned long> seed_documents;
+    // the set seed_documents are drawn with (see sampleWithoutReplacement())
+    vector<unsigned long> seed_slots;
+    // |c|^2 of each centroid in current_position
+    vector<double> squared_norms;
+    // how far each centroid moved since the bounds were last updated, and the bounds (see FitnessEngine)
+    vector<double> shifts;
+    DistanceBounds bounds;
     Options options;
     boost::mt19937_64 boost_generator64;
-    boost::uniform_01<boost::mt19937_64> get_random{boost_generator64};
     double current_fitness = 0.0;
     const DocumentSet* docset;
+    FitnessEngine fitness_engine;
     bool is_black_hole = false;
+
+    // Scores the star given up to date squared_norms
+    void score(const vector<unsigned>* sample);
 };
 
 #endif //PARTICLE
@@ -0,0 +1,72 @@
+#include "term_dictionary.h"
+
+const uint32_t TermDictionary::npos;
+
+// 64-bit FNV-1a
+uint64_t TermDictionary::hash(const char* term, uint32_t length, uint64_t basis)
+{
+    uint64_t h = basis;
+    for (uint32_t i = 0; i < length; i++) {
+        h = (h ^ (unsigned char)term[i]) * 1099511628211ull;
+    }
+    return h;
+}
+
+uint32_t TermDictionary::find(const char* term, uint32_t length) const
+{
+    uint64_t h = hash(term, length);
+    uint64_t mask = slots.size() - 1;
+    for (uint64_t slot = h & mask; ; slot = (slot + 1) & mask) {
+        uint32_t id = slots[slot];
+        if (id == npos) {
+            return npos;
+        }
+        if (hashes[id] == h && this->length(id) == length && memcmp(data(id), term, length) == 0) {
+            return id;
+        }
+    }
+}
+
+uint32_t TermDictionary::intern(const char* term, uint32_t length)
+{
+    uint64_t h = hash(term, length);
+    uint64_t mask = slots.size() - 1;
+    uint64_t slot = h & mask;
+    for (; slots[slot] != npos; slot = (slot + 1) & mask) {
+        uint32_t id = slots[slot];
+        if (hashes[id] == h && this->length(id) == length && memcmp(data(id), term, length) == 0) {
+            return id;
+        }
+    }
+
+    uint32_t id = hashes.size();
+    slots[slot] = id;
+    hashes.push_back(h);
+    arena.insert(arena.end(), term, term + length);
+    offsets.push_back(arena.size());
+    if (2 * hashes.size() > slots.size()) {
+        grow();
+    }
+    return id;
+}
+
+void TermDictionary::grow()
+{
+    vector<uint32_t>(2 * slots.size(), npos).swap(slots);
+    uint64_t mask = slots.size() - 1;
+    for (uint32_t id = 0, stop = hashes.size(); id < stop; id++) {
+        uint64_t slot = hashes[id] & mask;
+        while (slots[slot] != npos) {
+            slot = (slot + 1) & mask;
+        }
+        slots[slot] = id;
+    }
+}
+
+void TermDictionary::clear()
+{
+    slots.assign(16, npos);
+    hashes.clear();
+    arena.clear();
+    offsets.assign(1, 0);
+}
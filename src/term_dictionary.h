@@ -0,0 +1,86 @@
+#ifndef TERM_DICTIONARY
+#define TERM_DICTIONARY
+
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Interns terms, numbering them densely (0, 1, 2, ...) in the order they're first added.
+ *
+ * An open-addressing (linear probing) hash table of term ids, with the terms' characters stored one after the other
+ * in a single arena, so adding or finding a term never allocates anything per term.
+ */
+class TermDictionary {
+public:
+    static const uint32_t npos = UINT32_MAX;
+
+    TermDictionary() : slots(16, npos) {}
+
+    // The id of term, adding it if it's new
+    uint32_t intern(const char* term, uint32_t length);
+    uint32_t intern(const string & term) { return intern(term.data(), term.size()); }
+    // The id of term, or npos if it hasn't been added
+    uint32_t find(const char* term, uint32_t length) const;
+    uint32_t find(const string & term) const { return find(term.data(), term.size()); }
+
+    uint32_t size() const { return hashes.size(); }
+    // The characters of the term with the given id (not 0-terminated), valid until the next intern()
+    const char* data(uint32_t id) const { return arena.data() + offsets[id]; }
+    uint32_t length(uint32_t id) const { return offsets[id + 1] - offsets[id]; }
+    string term(uint32_t id) const { return string(data(id), length(id)); }
+
+    void clear();
+
+    // The hash terms are stored by (64-bit FNV-1a), a different basis gives a hash independent of it
+    static uint64_t hash(const char* term, uint32_t length, uint64_t basis = 14695981039346656037ull);
+
+private:
+    void grow();
+
+    // term ids, npos for an empty slot, size is always a power of two at least twice the number of terms
+    vector<uint32_t> slots;
+    // the hash of each term, so growing never needs to hash a term again, and most mismatches skip comparing it
+    vector<uint64_t> hashes;
+    // term i is arena[offsets[i], offsets[i + 1])
+    vector<char> arena;
+    vector<uint64_t> offsets {0};
+};
+
+/**
+ * Counts term ids (e.g. a file's terms), in an array indexed by id that is reset in time proportional to the number of
+ * different ids counted, not to its size.
+ */
+class TermCounter {
+public:
+    void add(uint32_t id) {
+        if (id >= counts.size()) {
+            counts.resize(max((unsigned long)id + 1, 2 * counts.size()), 0);
+        }
+        if (counts[id]++ == 0) {
+            ids.push_back(id);
+        }
+    }
+
+    // The ids counted, in the order they were first added
+    const vector<uint32_t> & terms() const { return ids; }
+    uint32_t count(uint32_t id) const { return counts[id]; }
+
+    void clear() {
+        for (auto id : ids) {
+            counts[id] = 0;
+        }
+        ids.clear();
+    }
+
+private:
+    vector<uint32_t> counts;
+    vector<uint32_t> ids;
+};
+
+#endif //TERM_DICTIONARY
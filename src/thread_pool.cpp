@@ -0,0 +1,81 @@
+#include "thread_pool.h"
+
+// set on the threads currently running a parallelFor() loop
+static thread_local bool in_parallel_loop = false;
+
+ThreadPool::ThreadPool(unsigned thread_count)
+{
+    for (unsigned i = 1; i < thread_count; i++) {
+        workers.push_back(thread(&ThreadPool::workerLoop, this));
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        unique_lock<mutex> guard(lock);
+        stopping = true;
+    }
+    work_available.notify_all();
+    for (auto & worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(unsigned long count, const std::function<void(unsigned long)> & f)
+{
+    if (workers.empty() || count <= 1 || in_parallel_loop) {
+        for (unsigned long i = 0; i < count; i++) {
+            f(i);
+        }
+        return;
+    }
+
+    {
+        unique_lock<mutex> guard(lock);
+        job = &f;
+        job_count = count;
+        next_index = 0;
+        busy_workers = workers.size();
+        job_generation++;
+    }
+    work_available.notify_all();
+
+    runIterations();
+
+    unique_lock<mutex> guard(lock);
+    work_done.wait(guard, [this] { return busy_workers == 0; });
+    job = nullptr;
+}
+
+void ThreadPool::workerLoop()
+{
+    uint64_t seen_generation = 0;
+
+    while (true) {
+        {
+            unique_lock<mutex> guard(lock);
+            work_available.wait(guard, [&] { return stopping || job_generation != seen_generation; });
+            if (stopping) {
+                return;
+            }
+            seen_generation = job_generation;
+        }
+
+        runIterations();
+
+        unique_lock<mutex> guard(lock);
+        if (--busy_workers == 0) {
+            work_done.notify_one();
+        }
+    }
+}
+
+void ThreadPool::runIterations()
+{
+    in_parallel_loop = true;
+    for (unsigned long i = next_index++; i < job_count; i = next_index++) {
+        (*job)(i);
+    }
+    in_parallel_loop = false;
+}
@@ -0,0 +1,60 @@
+#ifndef THREAD_POOL
+#define THREAD_POOL
+
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/**
+ * A fixed set of worker threads that run the iterations of a loop in parallel.
+ *
+ * Nested calls to parallelFor() (from inside a running loop) are run serially by the calling thread, so callers don't
+ * need to know whether they are already running on the pool.
+ */
+class ThreadPool {
+public:
+    /**
+     * @param   unsigned    thread_count    total number of threads to use, including the caller of parallelFor()
+     */
+    ThreadPool(unsigned thread_count);
+    ~ThreadPool();
+
+    /**
+     * Calls f(i) for every i in [0, count), returning once all of them have completed. The order in which the calls
+     * are made is unspecified, so f must not depend on it.
+     */
+    void parallelFor(unsigned long count, const std::function<void(unsigned long)> & f);
+    // Wraps f by reference, as a std::function copy of a lambda capturing more than a pointer or two allocates
+    template <typename F>
+    void parallelFor(unsigned long count, const F & f) {
+        parallelFor(count, std::function<void(unsigned long)>(std::cref(f)));
+    }
+
+    unsigned size() const { return workers.size() + 1; }
+
+private:
+    void workerLoop();
+    void runIterations();
+
+    vector<thread> workers;
+    mutex lock;
+    condition_variable work_available;
+    condition_variable work_done;
+    bool stopping = false;
+
+    // the loop currently being run
+    const std::function<void(unsigned long)>* job = nullptr;
+    unsigned long job_count = 0;
+    uint64_t job_generation = 0;
+    atomic<unsigned long> next_index {0};
+    unsigned busy_workers = 0;
+};
+
+#endif //THREAD_POOL
@@ -0,0 +1,71 @@
+#include "tokenizer.h"
+
+const unordered_set<string> StopWords { "a", "the", "in", "to", "i", "he", "she", "it" };
+
+void Tokenizer::findSkip(const char* from, const char* end)
+{
+    // enronRegex ("\*+[^\*]+\*+") matches from the first "*" run that is followed by something other than "*", up to
+    // and including the next "*" run. Without a next run nothing matches, here or anywhere further on.
+    skip_start = skip_end = end;
+    const char* p = (const char*)memchr(from, '*', end - from);
+    if (!p) {
+        return;
+    }
+    const char* q = p;
+    while (q != end && *q == '*') {
+        q++;
+    }
+    if (q == end) {
+        return;
+    }
+    const char* r = (const char*)memchr(q, '*', end - q);
+    if (!r) {
+        return;
+    }
+    while (r != end && *r == '*') {
+        r++;
+    }
+    skip_start = p;
+    skip_end = r;
+}
+
+map<string, int> RegexTokenizer::tokenize(const char* begin, const char* end) const
+{
+    //hack because all my test Enron docs have a boilerplate disclaimer
+    string updated = boost::regex_replace(string(begin, end), enronRegex, [] (const boost::smatch & m) -> string { return ""; });
+
+    vector<string> result;
+    boost::algorithm::split_regex(result, updated, tfidfRegex);
+
+    map<string, int> processed;
+    for (string & line : result) {
+        string tmp = boost::regex_replace(line, outerPunctRegex, [] (const boost::smatch & m) -> string { return ""; });
+        if (tmp.length() > 0) {
+            std::transform(tmp.begin(), tmp.end(), tmp.begin(), ::tolower);
+            if (boost::regex_match(tmp, validTokenRegex)) {
+                Porter2Stemmer::stem(tmp);
+                if (stop_words.find(tmp) == stop_words.end() && tmp.size() > 1) {
+                    if (processed.find(tmp) == processed.end()) {
+                        processed[tmp] = 1;
+                    } else {
+                        processed[tmp] += 1;
+                    }
+                }
+            } else {
+                vector<string> split_words;
+                boost::algorithm::split_regex(split_words, tmp, nonWordRegex);
+                for (string & split_line : split_words) {
+                    Porter2Stemmer::stem(split_line);
+                    if (stop_words.find(split_line) == stop_words.end() && split_line.size() > 1) {
+                        if (processed.find(split_line) == processed.end()) {
+                            processed[split_line] = 1;
+                        } else {
+                            processed[split_line] += 1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return processed;
+}
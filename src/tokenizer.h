@@ -0,0 +1,196 @@
+#ifndef TOKENIZER
+#define TOKENIZER
+
+#include "porter2_stemmer.h" //3rd party
+
+#include <string.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#define BOOST_NO_CXX11_SCOPED_ENUMS // fixes linker error when compiling on Linux
+
+#include <boost/regex.hpp>
+#include <boost/algorithm/string/regex.hpp>
+
+using namespace std;
+
+// Terms dropped after stemming
+extern const unordered_set<string> StopWords;
+
+/**
+ * Splits a file's text into stemmed terms, in a single pass over the bytes and without allocating anything once its
+ * buffers have grown to the longest token seen.
+ *
+ * The output is the same as RegexTokenizer's (the original implementation), i.e.:
+ *   - Enron disclaimers, "*" runs and everything up to and including the next "*" run, are removed,
+ *   - the text is split into tokens at whitespace, "(", ")", and runs of two or more "."s,
+ *   - each token has its leading and trailing non-letters removed, and is lower-cased,
+ *   - tokens made only of letters and ".=&'-@" are stemmed as a whole, any other token is split into its runs of
+ *     letters, each of which is stemmed,
+ *   - stems that are stop words or a single character long are dropped.
+ * Letters, whitespace and case are ASCII only, matching the regexes' [[:alpha:]] and [[:space:]] classes for the
+ * bytes of a UTF-8 locale.
+ */
+class Tokenizer {
+public:
+    Tokenizer(const unordered_set<string> & stop_words = StopWords) : stop_words(stop_words) {}
+
+    /**
+     * Calls emit(term) for every term of the text in [begin, end), in order. term is only valid during the call.
+     */
+    template <typename F>
+    void tokenize(const char* begin, const char* end, F emit);
+
+private:
+    static bool isLetter(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+    static bool isSpace(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
+    static bool isValidTokenChar(char c) {
+        return isLetter(c) || c == '.' || c == '=' || c == '&' || c == '\'' || c == '-' || c == '@';
+    }
+
+    // Finds the first disclaimer starting at or after from, setting skip_start and skip_end (or both to end if none)
+    void findSkip(const char* from, const char* end);
+
+    template <typename F>
+    void processToken(F & emit);
+
+    template <typename F>
+    void emitStem(string & word, F & emit);
+
+    const unordered_set<string> & stop_words;
+    string token;
+    string word;
+    const char* skip_start = nullptr;
+    const char* skip_end = nullptr;
+};
+
+template <typename F>
+void Tokenizer::tokenize(const char* begin, const char* end, F emit)
+{
+    token.clear();
+    findSkip(begin, end);
+
+    const char* p = begin;
+    while (p != end) {
+        if (p == skip_start) {
+            p = skip_end;
+            findSkip(p, end);
+            continue;
+        }
+
+        char c = *p++;
+        bool delimiter = isSpace(c) || c == '(' || c == ')';
+        if (c == '.') {
+            // only a run of at least two dots (after removing any disclaimers in between) is a delimiter
+            if (p != end && p == skip_start) {
+                p = skip_end;
+                findSkip(p, end);
+            }
+            if (p != end && *p == '.') {
+                delimiter = true;
+                while (p != end) {
+                    if (p == skip_start) {
+                        p = skip_end;
+                        findSkip(p, end);
+                    } else if (*p == '.') {
+                        p++;
+                    } else {
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (delimiter) {
+            processToken(emit);
+            token.clear();
+        } else {
+            token.push_back(c);
+        }
+    }
+    processToken(emit);
+}
+
+template <typename F>
+void Tokenizer::processToken(F & emit)
+{
+    unsigned long first = 0, last = token.size();
+    while (first < last && !isLetter(token[first])) {
+        first++;
+    }
+    while (last > first && !isLetter(token[last - 1])) {
+        last--;
+    }
+    if (first == last) {
+        return;
+    }
+
+    bool valid = true;
+    for (unsigned long i = first; i < last; i++) {
+        if (!isValidTokenChar(token[i])) {
+            valid = false;
+            break;
+        }
+    }
+
+    if (valid) {
+        word.assign(token, first, last - first);
+        emitStem(word, emit);
+    } else {
+        for (unsigned long i = first; i < last; ) {
+            unsigned long stop = i;
+            while (stop < last && isLetter(token[stop])) {
+                stop++;
+            }
+            if (stop > i) {
+                word.assign(token, i, stop - i);
+                emitStem(word, emit);
+            }
+            i = stop + 1;
+        }
+    }
+}
+
+template <typename F>
+void Tokenizer::emitStem(string & word, F & emit)
+{
+    for (auto & c : word) {
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+    }
+    Porter2Stemmer::stem(word);
+    if (word.size() > 1 && stop_words.find(word) == stop_words.end()) {
+        emit(word);
+    }
+}
+
+/**
+ * The original boost::regex implementation of Tokenizer, kept as the reference its output is checked against (see
+ * benchmark.cpp).
+ */
+class RegexTokenizer {
+public:
+    RegexTokenizer(const unordered_set<string> & stop_words = StopWords) : stop_words(stop_words) {}
+
+    // The number of times each term occurs in the text in [begin, end)
+    map<string, int> tokenize(const char* begin, const char* end) const;
+
+private:
+    const unordered_set<string> & stop_words;
+
+    // Left-over hack from testing on Enron documents, which have a boilerplate disclaimer
+    boost::regex enronRegex {"\\*+[^\\*]+\\*+"};
+    boost::regex tfidfRegex {"[[:space:]]+|[()]|\\.{2,}"};
+    boost::regex outerPunctRegex {"^[^[:alpha:]]+|[^[:alpha:]]+$"};
+    boost::regex wordRegex {"[[:alpha:]]+"};
+    //boost::regex validTokenRegex {"^(?:[[:alpha:]\\.=&'\\-@]+[/#]*)+$|^[[:digit:]:]+^"};
+    boost::regex validTokenRegex {"^[[:alpha:]\\.=&'\\-@]+$|^[[:digit:]:]+^"};
+    boost::regex nonWordRegex {"[^[:alpha:]]"};
+};
+
+#endif //TOKENIZER